@@ -0,0 +1,395 @@
+// prime_bench.c
+// One benchmark harness for every prime engine in the repo:
+//   serial      w4/task1.c   (first k primes, k taken from another engine's count)
+//   pthreads    w4/task2.c   (--threads p)
+//   openmp      w4/task3.c   (OMP_NUM_THREADS=p)
+//   mpi-cyclic  w8/search.c  (mpirun -np p)
+//   mpi-block   w8/mpi.c     (mpirun -np p, primes read back from primes_mpi.txt)
+// Every engine is run for every n and worker count. Each run's primes are counted and
+// hashed in order, and checked against the first engine that finished for that n. The
+// results go to stdout as CSV or JSON: wall time, speedup and efficiency against the
+// same engine's run with the fewest workers, and primes/sec. Wall time is measured around
+// the whole command, so it includes process (and mpirun) start-up and printing the primes.
+//
+// Compile the engines into one directory first, e.g.
+//   gcc -O2 -fopenmp -o bin/task1 w4/task1.c -lm
+//   gcc -O2 -pthread -o bin/task2 w4/task2.c -lm
+//   gcc -O2 -fopenmp -o bin/task3 w4/task3.c -lm
+//   mpicc -O2 -o bin/search w8/search.c -lm
+//   mpicc -O2 -fopenmp -o bin/mpi w8/mpi.c -lm
+// Compile: gcc -O2 -o prime_bench prime_bench.c
+// Run: ./prime_bench [--bin <dir>] [--n 1e6,1e7,...] [--workers 1,2,4] [--engines <list>]
+//                    [--format csv | json] [--timeout <sec>] [--pin compact | scatter | <cpu list>]
+// An engine can carry one of its own flags after a colon, e.g. --engines pthreads:--batch,mpi-block:--sieve.
+// --pin adds a pinned copy of every pthreads and openmp engine (--affinity=<spec>) and ends
+// with a pinned vs unpinned wall-time comparison on stderr.
+// MPIRUN overrides the launcher, e.g. MPIRUN="mpirun --oversubscribe".
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define MAX_LIST 32
+#define MAX_RUNS 1024
+#define MPI_OUTPUT_FILE "primes_mpi.txt"
+
+typedef enum
+{
+    ENGINE_SERIAL,
+    ENGINE_PTHREADS,
+    ENGINE_OPENMP,
+    ENGINE_MPI_CYCLIC,
+    ENGINE_MPI_BLOCK
+} EngineKind;
+
+typedef struct
+{
+    const char *name;
+    EngineKind kind;
+} EngineInfo;
+
+static const EngineInfo ENGINES[] = {
+    {"serial", ENGINE_SERIAL},
+    {"pthreads", ENGINE_PTHREADS},
+    {"openmp", ENGINE_OPENMP},
+    {"mpi-cyclic", ENGINE_MPI_CYCLIC},
+    {"mpi-block", ENGINE_MPI_BLOCK},
+};
+#define NUM_ENGINES (int)(sizeof(ENGINES) / sizeof(ENGINES[0]))
+
+typedef struct
+{
+    char label[64]; // engine name plus flag, as given on the command line
+    EngineKind kind;
+    char flag[64];
+    int unpinned; // for a --pin copy, index of the engine it was copied from; -1 otherwise
+} Engine;
+
+typedef struct
+{
+    const Engine *engine;
+    long long n;
+    int workers;
+    double wall;
+    long long count;
+    uint64_t checksum;
+    const char *status; // ok, mismatch, timeout, failed, skipped
+} Run;
+
+double time_diff(struct timespec start, struct timespec end)
+{
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// Order-sensitive hash of the prime sequence (FNV-1a over 64-bit values)
+uint64_t hash_prime(uint64_t h, uint64_t p)
+{
+    return (h ^ p) * 1099511628211ULL;
+}
+
+// Count and hash every all-digit token in a stream, skipping headings such as "Primes less than 30:"
+void scan_primes(FILE *f, long long *count, uint64_t *checksum)
+{
+    char token[64];
+    *count = 0;
+    *checksum = 14695981039346656037ULL;
+    while (fscanf(f, "%63s", token) == 1)
+    {
+        int digits = 1;
+        for (char *c = token; *c; c++)
+            digits &= isdigit((unsigned char)*c) != 0;
+        if (digits)
+        {
+            *checksum = hash_prime(*checksum, strtoull(token, NULL, 10));
+            (*count)++;
+        }
+    }
+}
+
+// Comma-separated list of numbers; accepts 1e6 style values
+int parse_list(const char *arg, long long *out)
+{
+    int k = 0;
+    char *copy = strdup(arg);
+    for (char *tok = strtok(copy, ","); tok != NULL && k < MAX_LIST; tok = strtok(NULL, ","))
+        out[k++] = (long long)strtod(tok, NULL);
+    free(copy);
+    return k;
+}
+
+int parse_engines(const char *arg, Engine *out)
+{
+    int k = 0;
+    char *copy = strdup(arg);
+    for (char *tok = strtok(copy, ","); tok != NULL && k < MAX_LIST; tok = strtok(NULL, ","))
+    {
+        char *colon = strchr(tok, ':');
+        snprintf(out[k].label, sizeof(out[k].label), "%s", tok);
+        snprintf(out[k].flag, sizeof(out[k].flag), "%s", colon ? colon + 1 : "");
+        if (colon)
+            *colon = '\0';
+
+        int found = -1;
+        for (int e = 0; e < NUM_ENGINES; e++)
+        {
+            if (strcmp(tok, ENGINES[e].name) == 0)
+                found = e;
+        }
+        if (found < 0)
+        {
+            fprintf(stderr, "Unknown engine: %s\n", tok);
+            free(copy);
+            return -1;
+        }
+        out[k].unpinned = -1;
+        out[k++].kind = ENGINES[found].kind;
+    }
+    free(copy);
+    return k;
+}
+
+// Run one engine; the primes are read from its stdout, or from primes_mpi.txt for mpi-block
+void run_engine(Run *r, const char *bin, const char *mpirun, int timeout, long long serial_count)
+{
+    char cmd[1024];
+    const Engine *e = r->engine;
+    const char *quiet = e->kind == ENGINE_MPI_BLOCK ? "> /dev/null 2>&1" : "2> /dev/null";
+
+    switch (e->kind)
+    {
+    case ENGINE_SERIAL:
+        snprintf(cmd, sizeof(cmd), "timeout %d %s/task1 %lld %s %s", timeout, bin, serial_count, e->flag, quiet);
+        break;
+    case ENGINE_PTHREADS:
+        snprintf(cmd, sizeof(cmd), "timeout %d %s/task2 %lld --threads %d %s %s", timeout, bin, r->n, r->workers,
+                 e->flag, quiet);
+        break;
+    case ENGINE_OPENMP:
+        snprintf(cmd, sizeof(cmd), "OMP_NUM_THREADS=%d timeout %d %s/task3 %lld %s %s", r->workers, timeout, bin,
+                 r->n, e->flag, quiet);
+        break;
+    case ENGINE_MPI_CYCLIC:
+        snprintf(cmd, sizeof(cmd), "timeout %d %s -np %d %s/search %lld %s %s", timeout, mpirun, r->workers, bin,
+                 r->n, e->flag, quiet);
+        break;
+    case ENGINE_MPI_BLOCK:
+        remove(MPI_OUTPUT_FILE);
+        snprintf(cmd, sizeof(cmd), "timeout %d %s -np %d %s/mpi %lld %s %s", timeout, mpirun, r->workers, bin, r->n,
+                 e->flag, quiet);
+        break;
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    FILE *p = popen(cmd, "r");
+    if (p == NULL)
+    {
+        r->status = "failed";
+        return;
+    }
+    scan_primes(p, &r->count, &r->checksum);
+    int status = pclose(p);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    r->wall = time_diff(t0, t1);
+
+    if (e->kind == ENGINE_MPI_BLOCK && status == 0)
+    {
+        FILE *f = fopen(MPI_OUTPUT_FILE, "r");
+        if (f == NULL)
+            status = -1;
+        else
+        {
+            scan_primes(f, &r->count, &r->checksum);
+            fclose(f);
+        }
+    }
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 124)
+        r->status = "timeout";
+    else if (status != 0)
+        r->status = "failed";
+    else
+        r->status = "ok";
+}
+
+int main(int argc, char *argv[])
+{
+    long long n_list[MAX_LIST] = {1000000, 10000000, 100000000, 1000000000};
+    int n_count = 4;
+    long long worker_list[MAX_LIST];
+    int worker_count = 0;
+    Engine engines[MAX_LIST];
+    int engine_count = parse_engines("pthreads,openmp,mpi-cyclic,mpi-block,serial", engines);
+    const char *bin = ".";
+    const char *format = "csv";
+    int timeout = 600;
+    const char *pin = NULL;
+
+    // Default worker counts: powers of two up to the core count, plus the core count itself
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    for (long w = 1; w < cores && worker_count < MAX_LIST - 1; w *= 2)
+        worker_list[worker_count++] = w;
+    worker_list[worker_count++] = cores;
+
+    int bad_args = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        int has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--bin") == 0 && has_value)
+            bin = argv[++i];
+        else if (strcmp(argv[i], "--n") == 0 && has_value)
+            n_count = parse_list(argv[++i], n_list);
+        else if (strcmp(argv[i], "--workers") == 0 && has_value)
+            worker_count = parse_list(argv[++i], worker_list);
+        else if (strcmp(argv[i], "--engines") == 0 && has_value)
+            engine_count = parse_engines(argv[++i], engines);
+        else if (strcmp(argv[i], "--format") == 0 && has_value)
+            format = argv[++i];
+        else if (strcmp(argv[i], "--timeout") == 0 && has_value)
+            timeout = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--pin") == 0 && has_value)
+            pin = argv[++i];
+        else
+            bad_args = 1;
+    }
+    if (bad_args || engine_count <= 0 || n_count == 0 || worker_count == 0 ||
+        (strcmp(format, "csv") != 0 && strcmp(format, "json") != 0))
+    {
+        printf("Usage: %s [--bin <dir>] [--n 1e6,1e7,...] [--workers 1,2,4] [--engines <list>]\n"
+               "          [--format csv | json] [--timeout <sec>] [--pin compact | scatter | <cpu list>]\n"
+               "Engines: serial, pthreads, openmp, mpi-cyclic, mpi-block (optionally name:--flag)\n",
+               argv[0]);
+        return 1;
+    }
+
+    // Pinned copies of the thread engines, run right after them
+    for (int ei = 0, listed = engine_count; ei < listed && pin != NULL && engine_count < MAX_LIST; ei++)
+    {
+        if (engines[ei].kind != ENGINE_PTHREADS && engines[ei].kind != ENGINE_OPENMP)
+            continue;
+        Engine *e = &engines[engine_count++];
+        *e = engines[ei];
+        e->unpinned = ei;
+        snprintf(e->label, sizeof(e->label), "%.40s+pin=%.16s", engines[ei].label, pin);
+        snprintf(e->flag, sizeof(e->flag), "%.24s --affinity=%.24s", engines[ei].flag, pin);
+    }
+
+    const char *mpirun = getenv("MPIRUN") ? getenv("MPIRUN") : "mpirun";
+    static Run runs[MAX_RUNS];
+    int run_count = 0, failures = 0;
+
+    for (int ni = 0; ni < n_count; ni++)
+    {
+        long long n = n_list[ni];
+        int ref = -1; // first successful run at this n
+
+        // The serial engine needs the prime count from another engine, so it goes last
+        for (int pass = 0; pass < 2; pass++)
+        {
+            for (int ei = 0; ei < engine_count; ei++)
+            {
+                if ((engines[ei].kind == ENGINE_SERIAL) != pass)
+                    continue;
+                int workers = engines[ei].kind == ENGINE_SERIAL ? 1 : worker_count;
+
+                for (int wi = 0; wi < workers && run_count < MAX_RUNS; wi++)
+                {
+                    Run *r = &runs[run_count++];
+                    memset(r, 0, sizeof(*r));
+                    r->engine = &engines[ei];
+                    r->n = n;
+                    r->workers = engines[ei].kind == ENGINE_SERIAL ? 1 : (int)worker_list[wi];
+
+                    if (engines[ei].kind == ENGINE_SERIAL && (ref < 0 || runs[ref].count == 0))
+                    {
+                        r->status = "skipped"; // no count to ask task1 for
+                        continue;
+                    }
+
+                    fprintf(stderr, "%-24s n=%-12lld workers=%-4d ", r->engine->label, n, r->workers);
+                    run_engine(r, bin, mpirun, timeout, ref >= 0 ? runs[ref].count : 0);
+
+                    if (strcmp(r->status, "ok") == 0)
+                    {
+                        if (ref < 0)
+                            ref = run_count - 1;
+                        else if (r->count != runs[ref].count || r->checksum != runs[ref].checksum)
+                            r->status = "mismatch";
+                    }
+                    if (strcmp(r->status, "mismatch") == 0 || strcmp(r->status, "failed") == 0)
+                        failures++; // a timeout just means n was too large for this engine
+                    fprintf(stderr, "%9.3f s  %s\n", r->wall, r->status);
+                }
+            }
+        }
+    }
+
+    int json = strcmp(format, "json") == 0;
+    if (json)
+        printf("[\n");
+    else
+        printf("engine,n,workers,wall_sec,primes,checksum,speedup,efficiency,primes_per_sec,status\n");
+
+    for (int i = 0; i < run_count; i++)
+    {
+        Run *r = &runs[i];
+
+        // Baseline: this engine's successful run with the fewest workers at the same n
+        const Run *base = NULL;
+        for (int j = 0; j < run_count; j++)
+        {
+            const Run *b = &runs[j];
+            if (b->engine == r->engine && b->n == r->n && strcmp(b->status, "ok") == 0 &&
+                (base == NULL || b->workers < base->workers))
+                base = b;
+        }
+        int ok = strcmp(r->status, "ok") == 0;
+        double speedup = ok && base ? base->wall / r->wall : 0;
+        double efficiency = ok && base ? speedup * base->workers / r->workers : 0;
+        double rate = ok && r->wall > 0 ? r->count / r->wall : 0;
+
+        if (json)
+        {
+            printf("  {\"engine\": \"%s\", \"n\": %lld, \"workers\": %d, \"wall_sec\": %.6f, \"primes\": %lld, "
+                   "\"checksum\": \"%016llx\", \"speedup\": %.4f, \"efficiency\": %.4f, \"primes_per_sec\": %.1f, "
+                   "\"status\": \"%s\"}%s\n",
+                   r->engine->label, r->n, r->workers, r->wall, r->count, (unsigned long long)r->checksum, speedup,
+                   efficiency, rate, r->status, i + 1 < run_count ? "," : "");
+        }
+        else
+        {
+            printf("%s,%lld,%d,%.6f,%lld,%016llx,%.4f,%.4f,%.1f,%s\n", r->engine->label, r->n, r->workers, r->wall,
+                   r->count, (unsigned long long)r->checksum, speedup, efficiency, rate, r->status);
+        }
+    }
+    if (json)
+        printf("]\n");
+
+    if (pin != NULL)
+    {
+        fprintf(stderr, "\nPinning (%s) vs unpinned, same n and workers:\n", pin);
+        for (int i = 0; i < run_count; i++)
+        {
+            const Run *p = &runs[i];
+            if (p->engine->unpinned < 0 || strcmp(p->status, "ok") != 0)
+                continue;
+            for (int j = 0; j < run_count; j++)
+            {
+                const Run *u = &runs[j];
+                if (u->engine == &engines[p->engine->unpinned] && u->n == p->n && u->workers == p->workers &&
+                    strcmp(u->status, "ok") == 0)
+                {
+                    fprintf(stderr, "  %-24s n=%-12lld workers=%-4d unpinned %8.3f s  pinned %8.3f s  (%.2fx)\n",
+                            u->engine->label, p->n, p->workers, u->wall, p->wall, p->wall > 0 ? u->wall / p->wall : 0);
+                }
+            }
+        }
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,209 @@
+// affinity.h
+// Thread-to-CPU placement for the pthreads and OpenMP programs (Linux).
+//
+// A plan maps thread i to one CPU, cycling when there are more threads than CPUs:
+//   compact   fill one NUMA node before the next (CPUs ordered by node, then id)
+//   scatter   round-robin over the nodes, so consecutive threads land on different nodes
+//   <list>    explicit CPUs in thread order, e.g. 0,2,4-7
+// Only CPUs in the process's current affinity mask are used, and nodes come from
+// /sys/devices/system/node (everything is node 0 if that is missing). A pinned thread
+// that allocates and first writes its own buffers gets them on its local node under
+// Linux's default first-touch policy, so pinning before the first write is what matters:
+// affinity_thread_create() pins through the thread attributes, before the thread runs;
+// OpenMP threads call affinity_pin_self() at the top of their first parallel region.
+//
+// Needs _GNU_SOURCE defined before the first system header. Header-only; include with
+// #include "../common/affinity.h".
+
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+
+#define AFFINITY_MAX_NODES 64
+
+typedef struct
+{
+    char name[64]; // spec as given, "none" when off
+    int count;     // 0: leave placement to the OS
+    int cpus[CPU_SETSIZE];
+    int nodes[CPU_SETSIZE]; // NUMA node of cpus[i]
+} AffinityPlan;
+
+// Parse a CPU list such as "0,2,4-7" into out; returns the count, or -1 if malformed
+static inline int affinity_parse_list(const char *s, int *out, int max)
+{
+    int count = 0;
+    while (*s != '\0' && *s != '\n')
+    {
+        char *end;
+        long lo = strtol(s, &end, 10), hi = lo;
+        if (end == s || lo < 0)
+            return -1;
+        s = end;
+        if (*s == '-')
+        {
+            hi = strtol(s + 1, &end, 10);
+            if (end == s + 1 || hi < lo)
+                return -1;
+            s = end;
+        }
+        for (long c = lo; c <= hi; c++)
+        {
+            if (count == max || c >= CPU_SETSIZE)
+                return -1;
+            out[count++] = (int)c;
+        }
+        if (*s == ',')
+            s++;
+        else if (*s != '\0' && *s != '\n')
+            return -1;
+    }
+    return count;
+}
+
+// NUMA node of every CPU, from /sys/devices/system/node/node<k>/cpulist
+static inline void affinity_cpu_nodes(int *node_of)
+{
+    memset(node_of, 0, sizeof(int) * CPU_SETSIZE);
+    static int cpus[CPU_SETSIZE];
+    for (int k = 0; k < AFFINITY_MAX_NODES; k++)
+    {
+        char path[96], line[4096];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", k);
+        FILE *f = fopen(path, "r");
+        if (f == NULL)
+            continue;
+        int count = fgets(line, sizeof(line), f) ? affinity_parse_list(line, cpus, CPU_SETSIZE) : -1;
+        fclose(f);
+        for (int i = 0; i < count; i++)
+            node_of[cpus[i]] = k;
+    }
+}
+
+// Build a plan from spec (compact, scatter, none or a CPU list); 0 on success, -1 if the
+// spec is malformed or names a CPU this process may not run on
+static inline int affinity_plan(AffinityPlan *plan, const char *spec)
+{
+    memset(plan, 0, sizeof(*plan));
+    snprintf(plan->name, sizeof(plan->name), "%s", spec != NULL ? spec : "none");
+    if (spec == NULL || strcmp(spec, "none") == 0)
+        return 0;
+
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return -1;
+    static int node_of[CPU_SETSIZE];
+    affinity_cpu_nodes(node_of);
+
+    if (strcmp(spec, "compact") == 0 || strcmp(spec, "scatter") == 0)
+    {
+        // Allowed CPUs grouped by node, ascending within each node
+        static int by_node[AFFINITY_MAX_NODES][CPU_SETSIZE];
+        int per_node[AFFINITY_MAX_NODES] = {0};
+        int num_nodes = 0;
+        for (int c = 0; c < CPU_SETSIZE; c++)
+        {
+            if (!CPU_ISSET(c, &allowed))
+                continue;
+            int k = node_of[c] < AFFINITY_MAX_NODES ? node_of[c] : 0;
+            by_node[k][per_node[k]++] = c;
+            if (k + 1 > num_nodes)
+                num_nodes = k + 1;
+        }
+
+        if (spec[0] == 'c')
+        {
+            for (int k = 0; k < num_nodes; k++)
+                for (int i = 0; i < per_node[k]; i++)
+                    plan->cpus[plan->count++] = by_node[k][i];
+        }
+        else
+        {
+            for (int i = 0, added = 1; added; i++)
+            {
+                added = 0;
+                for (int k = 0; k < num_nodes; k++)
+                {
+                    if (i < per_node[k])
+                    {
+                        plan->cpus[plan->count++] = by_node[k][i];
+                        added = 1;
+                    }
+                }
+            }
+        }
+    }
+    else
+    {
+        plan->count = affinity_parse_list(spec, plan->cpus, CPU_SETSIZE);
+        if (plan->count <= 0)
+        {
+            plan->count = 0;
+            return -1;
+        }
+        for (int i = 0; i < plan->count; i++)
+        {
+            if (!CPU_ISSET(plan->cpus[i], &allowed))
+            {
+                plan->count = 0;
+                return -1;
+            }
+        }
+    }
+
+    for (int i = 0; i < plan->count; i++)
+        plan->nodes[i] = node_of[plan->cpus[i]];
+    return 0;
+}
+
+static inline int affinity_cpu(const AffinityPlan *plan, int thread)
+{
+    return plan->count > 0 ? plan->cpus[thread % plan->count] : -1;
+}
+
+// Start thread i already pinned to its CPU (plain pthread_create when the plan is off)
+static inline int affinity_thread_create(const AffinityPlan *plan, int thread, pthread_t *t,
+                                         void *(*fn)(void *), void *arg)
+{
+    if (plan->count == 0)
+        return pthread_create(t, NULL, fn, arg);
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(affinity_cpu(plan, thread), &set);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    int rc = pthread_create(t, &attr, fn, arg);
+    pthread_attr_destroy(&attr);
+    return rc;
+}
+
+// Pin the calling thread as thread i of the plan
+static inline void affinity_pin_self(const AffinityPlan *plan, int thread)
+{
+    if (plan->count == 0)
+        return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(affinity_cpu(plan, thread), &set);
+    sched_setaffinity(0, sizeof(set), &set);
+}
+
+// One line per plan: where each of the first num_threads threads runs
+static inline void affinity_describe(const AffinityPlan *plan, int num_threads, FILE *out)
+{
+    if (plan->count == 0)
+        return;
+    fprintf(out, "Affinity %s:", plan->name);
+    for (int i = 0; i < num_threads; i++)
+        fprintf(out, " %d->cpu%d/node%d", i, affinity_cpu(plan, i), plan->nodes[i % plan->count]);
+    fprintf(out, "\n");
+}
+
+#endif
@@ -0,0 +1,242 @@
+// bucket_sieve.h
+// Exact segmented sieve of a 64-bit window [lo, hi) with bucketed large primes, after
+// Oliveira e Silva's bucket sieve.
+//
+// Segments hold odd numbers only, one byte each, BUCKET_SIEVE_SEGMENT_BYTES (L2-sized) at
+// a time. Sieving primes below the segment length hit every segment, so they are crossed
+// off the usual way, each keeping its next multiple between segments. Far beyond 10^12
+// almost every sieving prime is larger than that and hits a segment at most once, so
+// scanning the whole list per segment would mostly find nothing to do. Instead each large
+// prime sits in the bucket of the next segment it hits, as (prime, offset in that segment).
+// Sieving a segment drains its bucket, crosses off one byte per entry and moves the entry
+// to the bucket of its next hit. The buckets form a ring as long as the largest prime's
+// stride in segments, and entries live in fixed-size blocks recycled through a free list,
+// so the work per segment follows the hits and the memory follows the number of primes. A
+// large prime joins the buckets once the sieve reaches its square.
+//
+// Every prime up to sqrt(hi) is needed (4 bytes each, plus 8 per bucket entry), which
+// limits hi to BUCKET_SIEVE_MAX_HI; survivors are exact, no primality test follows.
+//
+// Header-only; include with #include "../common/bucket_sieve.h".
+
+#ifndef BUCKET_SIEVE_H
+#define BUCKET_SIEVE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "prime_kernel.h"
+
+#define BUCKET_SIEVE_SEGMENT_BYTES 262144 // odd numbers per segment (covers 2^19 integers)
+#define BUCKET_SIEVE_BLOCK 1024           // entries per bucket block
+#define BUCKET_SIEVE_MAX_HI 4611686014132420609ULL // (2^31 - 1)^2: sieving primes stay below 2^31
+
+typedef struct
+{
+    uint32_t prime;
+    uint32_t index; // odd offset of the hit inside the bucket's segment
+} BucketEntry;
+
+typedef struct BucketBlock
+{
+    struct BucketBlock *next;
+    int count;
+    BucketEntry entries[BUCKET_SIEVE_BLOCK];
+} BucketBlock;
+
+typedef struct
+{
+    uint64_t lo, hi;
+    uint64_t base;       // even; odd index i stands for base + 2i + 1
+    uint64_t total;      // odd indices covering [base, hi)
+    uint64_t segment;    // next segment to sieve
+    const uint32_t *primes; // odd sieving primes up to sqrt(hi - 1), ascending
+    long long count;
+    long long small_count; // primes[0 .. small_count) are sieved directly ...
+    uint64_t *small_next;  // ... from these absolute odd indices
+    long long started;     // primes[small_count .. started) are in the buckets
+    int num_buckets;
+    BucketBlock **buckets; // ring: segment s uses buckets[s % num_buckets]
+    BucketBlock *free_blocks;
+    int blocks; // blocks allocated so far
+    long long hits; // bytes crossed off through the buckets
+    unsigned char *bits;
+} BucketSieve;
+
+// Odd primes in [3, limit] as a new uint32_t array, sieved in int-sized pieces with the kernel
+static inline uint32_t *bucket_sieve_primes(uint32_t limit, long long *count)
+{
+    int small_count;
+    int *small = prime_sieve_small((int)sqrt((double)limit) + 1, &small_count);
+    long long capacity = limit < 100 ? 32 : (long long)(1.3 * limit / log((double)limit)) + 32;
+    uint32_t *primes = malloc(sizeof(uint32_t) * capacity);
+    int *chunk = malloc(sizeof(int) * (PRIME_KERNEL_SEGMENT / 2 + 2));
+    *count = 0;
+    for (long long lo = 3; lo <= limit; lo += PRIME_KERNEL_SEGMENT)
+    {
+        long long hi = lo + PRIME_KERNEL_SEGMENT - 1 < limit ? lo + PRIME_KERNEL_SEGMENT - 1 : limit;
+        int found = prime_sieve_range((int)lo, (int)hi, small, small_count, chunk);
+        for (int i = 0; i < found; i++)
+            primes[(*count)++] = (uint32_t)chunk[i];
+    }
+    free(chunk);
+    free(small);
+    return primes;
+}
+
+static inline void bucket_sieve_push(BucketSieve *bs, uint64_t segment, uint32_t prime, uint32_t index)
+{
+    BucketBlock **head = &bs->buckets[segment % bs->num_buckets];
+    if (*head == NULL || (*head)->count == BUCKET_SIEVE_BLOCK)
+    {
+        BucketBlock *b = bs->free_blocks;
+        if (b != NULL)
+            bs->free_blocks = b->next;
+        else
+        {
+            b = malloc(sizeof(BucketBlock));
+            bs->blocks++;
+        }
+        b->count = 0;
+        b->next = *head;
+        *head = b;
+    }
+    BucketEntry *e = &(*head)->entries[(*head)->count++];
+    e->prime = prime;
+    e->index = index;
+}
+
+// Absolute odd index of the first odd multiple of p that is >= max(p * p, bs->lo)
+static inline uint64_t bucket_sieve_first(const BucketSieve *bs, uint64_t p)
+{
+    uint64_t from = p * p > bs->lo ? p * p : bs->lo;
+    uint64_t m = (from + p - 1) / p * p;
+    if (m % 2 == 0)
+        m += p;
+    return (m - bs->base - 1) / 2;
+}
+
+// Set up the window [lo, hi), hi <= BUCKET_SIEVE_MAX_HI. primes (see bucket_sieve_primes)
+// must reach sqrt(hi - 1) and stay valid until bucket_sieve_free.
+static inline void bucket_sieve_init(BucketSieve *bs, uint64_t lo, uint64_t hi, const uint32_t *primes,
+                                     long long count)
+{
+    memset(bs, 0, sizeof(*bs));
+    bs->lo = lo < 2 ? 2 : lo;
+    bs->hi = hi > bs->lo ? hi : bs->lo;
+    bs->base = bs->lo & ~1ULL;
+    bs->total = (bs->hi - bs->base) / 2;
+    bs->primes = primes;
+
+    uint64_t root = (uint64_t)sqrt((double)(bs->hi - 1));
+    while (root * root > bs->hi - 1)
+        root--;
+    while ((root + 1) * (root + 1) <= bs->hi - 1)
+        root++;
+    while (bs->count < count && primes[bs->count] <= root)
+        bs->count++;
+
+    while (bs->small_count < bs->count && primes[bs->small_count] < BUCKET_SIEVE_SEGMENT_BYTES)
+        bs->small_count++;
+    bs->small_next = malloc(sizeof(uint64_t) * (bs->small_count + 1));
+    for (long long i = 0; i < bs->small_count; i++)
+        bs->small_next[i] = bucket_sieve_first(bs, primes[i]);
+    bs->started = bs->small_count;
+
+    // A hit moves at most one stride (p odd indices) ahead, so the ring needs that many segments
+    uint64_t largest = bs->count > bs->small_count ? primes[bs->count - 1] : 0;
+    bs->num_buckets = (int)(largest / BUCKET_SIEVE_SEGMENT_BYTES) + 2;
+    bs->buckets = calloc(bs->num_buckets, sizeof(BucketBlock *));
+    bs->bits = malloc(BUCKET_SIEVE_SEGMENT_BYTES);
+}
+
+static inline void bucket_sieve_free(BucketSieve *bs)
+{
+    for (int i = 0; i < bs->num_buckets; i++)
+    {
+        while (bs->buckets[i] != NULL)
+        {
+            BucketBlock *next = bs->buckets[i]->next;
+            free(bs->buckets[i]);
+            bs->buckets[i] = next;
+        }
+    }
+    while (bs->free_blocks != NULL)
+    {
+        BucketBlock *next = bs->free_blocks->next;
+        free(bs->free_blocks);
+        bs->free_blocks = next;
+    }
+    free(bs->buckets);
+    free(bs->small_next);
+    free(bs->bits);
+}
+
+// Sieve the next segment and write its primes, ascending, to out (room for
+// BUCKET_SIEVE_SEGMENT_BYTES + 1 values); returns how many, or -1 past the end of the window
+static inline long long bucket_sieve_next(BucketSieve *bs, uint64_t *out)
+{
+    uint64_t first = bs->segment * BUCKET_SIEVE_SEGMENT_BYTES;
+    int has_two = bs->segment == 0 && bs->lo <= 2 && bs->hi > 2; // [2, 3) has no odd index at all
+    if (first >= bs->total && !has_two)
+        return -1;
+    uint64_t len = first >= bs->total ? 0 : bs->total - first < BUCKET_SIEVE_SEGMENT_BYTES ? bs->total - first : BUCKET_SIEVE_SEGMENT_BYTES;
+    uint64_t end = first + len;
+    unsigned char *bits = bs->bits;
+    memset(bits, 1, len);
+
+    for (long long i = 0; i < bs->small_count; i++)
+    {
+        uint64_t p = bs->primes[i];
+        uint64_t j = bs->small_next[i];
+        for (; j < end; j += p)
+            bits[j - first] = 0;
+        bs->small_next[i] = j;
+    }
+
+    // Large primes whose square falls in this segment join the buckets (at this segment)
+    uint64_t top = bs->base + 2 * end; // every value here is below top
+    while (bs->started < bs->count && (uint64_t)bs->primes[bs->started] * bs->primes[bs->started] < top)
+    {
+        uint32_t p = bs->primes[bs->started++];
+        uint64_t j = bucket_sieve_first(bs, p);
+        if (j < bs->total)
+            bucket_sieve_push(bs, j / BUCKET_SIEVE_SEGMENT_BYTES, p, (uint32_t)(j % BUCKET_SIEVE_SEGMENT_BYTES));
+    }
+
+    // Drain this segment's bucket; every entry moves strictly forward, never into this bucket
+    BucketBlock **slot = &bs->buckets[bs->segment % bs->num_buckets];
+    BucketBlock *list = *slot;
+    *slot = NULL;
+    while (list != NULL)
+    {
+        for (int k = 0; k < list->count; k++)
+        {
+            BucketEntry e = list->entries[k];
+            bits[e.index] = 0;
+            uint64_t next = first + e.index + e.prime;
+            if (next < bs->total)
+                bucket_sieve_push(bs, next / BUCKET_SIEVE_SEGMENT_BYTES, e.prime,
+                                  (uint32_t)(next % BUCKET_SIEVE_SEGMENT_BYTES));
+        }
+        bs->hits += list->count;
+        BucketBlock *done = list;
+        list = list->next;
+        done->next = bs->free_blocks;
+        bs->free_blocks = done;
+    }
+
+    long long count = 0;
+    if (has_two)
+        out[count++] = 2;
+    for (uint64_t i = 0; i < len; i++)
+    {
+        uint64_t v = bs->base + 2 * (first + i) + 1;
+        if (bits[i] && v >= bs->lo && v > 1)
+            out[count++] = v;
+    }
+    bs->segment++;
+    return count;
+}
+
+#endif
@@ -0,0 +1,123 @@
+// goldbach.h
+// Distributed check of Goldbach's conjecture: every even 4 <= m < n is the sum of two primes.
+//
+// Each rank owns a contiguous block of mod-30 wheel bytes (see wheel30.h) and sieves it,
+// together with a margin below it as wide as the small-primes table, into one local
+// bitset. For every even m in its block it walks the table upwards and stops at the
+// first p with m - p prime; m - p then almost always lies in the bitset, so each step
+// is one bit test. The (rare) m whose minimal p is past the table keeps going with
+// prime_test_u32 on both parts. The ranks reduce the number of evens checked, the
+// largest minimal p with the first m that needs it (MPI_MAXLOC), and the smallest m
+// without any decomposition, which would be a counterexample.
+//
+// Header-only; include with #include "../common/goldbach.h" from an MPI program.
+
+#ifndef GOLDBACH_H
+#define GOLDBACH_H
+
+#include <stdlib.h>
+#include <limits.h>
+#include <mpi.h>
+#include "prime_kernel.h"
+
+typedef struct
+{
+    long long evens;     // even numbers checked
+    int max_p;           // largest minimal p over all of them ...
+    int max_p_at;        // ... and the first m that needs it
+    int counterexample;  // smallest m with no decomposition, INT_MAX if none
+    long long fallbacks; // evens whose minimal p was beyond the small-primes table
+    double seconds;      // slowest rank's check time
+} GoldbachResult;
+
+// Local primality for 0 <= q < n: bits cover [30 * bits_lo, ...), anything below goes to the kernel
+static inline int goldbach_is_prime(const unsigned char *bits, long long bits_lo, int q)
+{
+    if (q < 7)
+        return q == 2 || q == 3 || q == 5;
+    if (q >= 30 * bits_lo)
+        return wheel30_test(bits, q - 30 * bits_lo);
+    return prime_test_u32((uint32_t)q);
+}
+
+// Smallest prime p with m - p prime, or 0 if there is none
+static inline int goldbach_min_p(int m, const int *small_primes, int small_count, const unsigned char *bits,
+                                 long long bits_lo, long long *fallbacks)
+{
+    for (int i = 0; i < small_count && small_primes[i] <= m / 2; i++)
+    {
+        if (goldbach_is_prime(bits, bits_lo, m - small_primes[i]))
+            return small_primes[i];
+    }
+    if (small_count > 0 && small_primes[small_count - 1] >= m / 2)
+        return 0;
+
+    (*fallbacks)++;
+    int p = small_count > 0 ? small_primes[small_count - 1] + 1 : 2;
+    if (p > 2 && p % 2 == 0)
+        p++;
+    for (; p <= m / 2; p += (p == 2) ? 1 : 2)
+    {
+        if (prime_test_u32((uint32_t)p) && prime_test_u32((uint32_t)(m - p)))
+            return p;
+    }
+    return 0;
+}
+
+// Check every even 4 <= m < n. small_primes (ascending, from 2) must cover sqrt(n); it is
+// also the table walked for p. Collective over comm; the result is valid on rank 0.
+static inline void goldbach_mpi(int n, const int *small_primes, int small_count, MPI_Comm comm,
+                                GoldbachResult *result)
+{
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    double start = MPI_Wtime();
+
+    long long total_bytes = wheel30_bytes(n);
+    long long byte_lo = total_bytes * rank / size;
+    long long byte_hi = total_bytes * (rank + 1) / size;
+
+    // The block plus a margin of the largest table prime, so m - p stays inside
+    long long margin = small_count > 0 ? wheel30_bytes(small_primes[small_count - 1]) : 0;
+    long long bits_lo = byte_lo > margin ? byte_lo - margin : 0;
+    unsigned char *bits = malloc(byte_hi - bits_lo + 1);
+    wheel30_sieve(bits, bits_lo, byte_hi, small_primes, small_count);
+
+    long long evens = 0, fallbacks = 0;
+    int local_max[2] = {0, 0}; // minimal p, m
+    int local_fail = INT_MAX;
+    long long m_lo = 30 * byte_lo < 4 ? 4 : 30 * byte_lo;
+    long long m_hi = 30 * byte_hi < n ? 30 * byte_hi : n;
+    for (long long m = m_lo; m < m_hi; m += 2)
+    {
+        int p = goldbach_min_p((int)m, small_primes, small_count, bits, bits_lo, &fallbacks);
+        evens++;
+        if (p == 0)
+        {
+            if (m < local_fail)
+                local_fail = (int)m;
+        }
+        else if (p > local_max[0])
+        {
+            local_max[0] = p;
+            local_max[1] = (int)m;
+        }
+    }
+    free(bits);
+    double elapsed = MPI_Wtime() - start;
+
+    // MPI_MAXLOC keeps the smallest m among equal p
+    int global_max[2] = {0, 0};
+    long long local_counts[2] = {evens, fallbacks}, counts[2] = {0, 0};
+    MPI_Reduce(local_max, global_max, 1, MPI_2INT, MPI_MAXLOC, 0, comm);
+    MPI_Reduce(local_counts, counts, 2, MPI_LONG_LONG, MPI_SUM, 0, comm);
+    MPI_Reduce(&local_fail, &result->counterexample, 1, MPI_INT, MPI_MIN, 0, comm);
+    MPI_Reduce(&elapsed, &result->seconds, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+    result->max_p = global_max[0];
+    result->max_p_at = global_max[1];
+    result->evens = counts[0];
+    result->fallbacks = counts[1];
+}
+
+#endif
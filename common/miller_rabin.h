@@ -0,0 +1,122 @@
+// miller_rabin.h
+// Deterministic Miller-Rabin for 64-bit integers using Montgomery multiplication.
+//
+// Montgomery form keeps every modular product to two 64x64->128 multiplies and a
+// subtraction, with no hardware division in the exponentiation loop. The seven bases
+// {2, 325, 9375, 28178, 450775, 9780504, 1795265022} are proven correct for every
+// n < 2^64 (Jim Sinclair, 2011).
+//
+// Header-only; include with #include "../common/miller_rabin.h".
+
+#ifndef MILLER_RABIN_H
+#define MILLER_RABIN_H
+
+#include <stdint.h>
+
+typedef unsigned __int128 mr_u128;
+
+typedef struct
+{
+    uint64_t n;    // odd modulus
+    uint64_t ninv; // n^-1 mod 2^64
+    uint64_t one;  // 2^64 mod n, i.e. 1 in Montgomery form
+    uint64_t r2;   // 2^128 mod n, for converting into Montgomery form
+} Mont64;
+
+static inline void mont_init(Mont64 *m, uint64_t n)
+{
+    m->n = n;
+    uint64_t inv = n; // correct to 3 bits for odd n; each Newton step doubles that
+    for (int i = 0; i < 5; i++)
+        inv *= 2 - n * inv;
+    m->ninv = inv;
+    m->one = (uint64_t)(-n) % n;
+    m->r2 = (uint64_t)(((mr_u128)m->one * m->one) % n);
+}
+
+// t * 2^-64 mod n, for t < n * 2^64
+static inline uint64_t mont_reduce(const Mont64 *m, mr_u128 t)
+{
+    uint64_t q = (uint64_t)t * m->ninv;
+    uint64_t h = (uint64_t)(((mr_u128)q * m->n) >> 64);
+    uint64_t hi = (uint64_t)(t >> 64);
+    return hi >= h ? hi - h : hi - h + m->n;
+}
+
+static inline uint64_t mont_mul(const Mont64 *m, uint64_t a, uint64_t b)
+{
+    return mont_reduce(m, (mr_u128)a * b);
+}
+
+static inline uint64_t mont_to(const Mont64 *m, uint64_t a)
+{
+    return mont_mul(m, a % m->n, m->r2);
+}
+
+// base^e in Montgomery form (base already in Montgomery form)
+static inline uint64_t mont_pow(const Mont64 *m, uint64_t base, uint64_t e)
+{
+    uint64_t result = m->one;
+    while (e > 0)
+    {
+        if (e & 1)
+            result = mont_mul(m, result, base);
+        base = mont_mul(m, base, base);
+        e >>= 1;
+    }
+    return result;
+}
+
+// One Miller-Rabin round: 0 if a proves n composite
+static inline int mr_round(const Mont64 *m, uint64_t a, uint64_t d, int s)
+{
+    a %= m->n;
+    if (a == 0)
+        return 1;
+    uint64_t minus_one = m->n - m->one; // -1 in Montgomery form
+    uint64_t x = mont_pow(m, mont_to(m, a), d);
+    if (x == m->one || x == minus_one)
+        return 1;
+    for (int i = 1; i < s; i++)
+    {
+        x = mont_mul(m, x, x);
+        if (x == minus_one)
+            return 1;
+    }
+    return 0;
+}
+
+static inline int is_prime_u64(uint64_t n)
+{
+    static const uint64_t small[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+    static const uint64_t bases[] = {2, 325, 9375, 28178, 450775, 9780504, 1795265022};
+
+    if (n < 2)
+        return 0;
+    for (int i = 0; i < 12; i++)
+    {
+        if (n % small[i] == 0)
+            return n == small[i];
+    }
+    if (n < 37 * 37)
+        return 1;
+
+    uint64_t d = n - 1;
+    int s = 0;
+    while ((d & 1) == 0)
+    {
+        d >>= 1;
+        s++;
+    }
+
+    Mont64 m;
+    mont_init(&m, n);
+    for (int i = 0; i < 7; i++)
+    {
+        if (!mr_round(&m, bases[i], d, s))
+            return 0;
+    }
+    return 1;
+}
+
+#endif
@@ -0,0 +1,152 @@
+// mpi_trace.h
+// Lightweight per-rank phase timers for MPI programs, with a load-imbalance report and an
+// optional Chrome-trace timeline.
+//
+// Wrap a block in a scoped timer and give it a kind:
+//     MPI_TRACE_SCOPE(MPI_TRACE_COMM, "gather") { MPI_Gatherv(...); }
+// (or pair mpi_trace_begin() / mpi_trace_end() where a block does not fit). Times come from
+// MPI_Wtime. Each rank adds the outermost scopes to its compute, communication and I/O
+// totals; nested scopes only show up in the timeline. Do not leave a scope with break or
+// return, its end would be skipped. mpi_trace_report() reduces min/avg/max of every total
+// and of the wall time over the ranks, with max/avg as the imbalance ratio. If MPI_TRACE
+// is set in the environment, every rank also writes <MPI_TRACE>.<rank>.json, which
+// chrome://tracing or Perfetto loads (several files at once give one row per rank).
+//
+// Header-only; include with #include "../common/mpi_trace.h" from an MPI program.
+
+#ifndef MPI_TRACE_H
+#define MPI_TRACE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <mpi.h>
+
+typedef enum
+{
+    MPI_TRACE_COMPUTE,
+    MPI_TRACE_COMM,
+    MPI_TRACE_IO,
+    MPI_TRACE_KINDS
+} MpiTraceKind;
+
+static const char *const MPI_TRACE_KIND_NAMES[MPI_TRACE_KINDS] = {"compute", "communication", "I/O"};
+
+typedef struct
+{
+    const char *name; // string literal, not copied
+    int kind;
+    double start, end;
+} MpiTraceEvent;
+
+static struct
+{
+    int rank;
+    int depth; // open scopes
+    double origin;
+    double total[MPI_TRACE_KINDS];
+    const char *path; // timeline file prefix, NULL when off
+    MpiTraceEvent *events;
+    int count, capacity;
+} mpi_trace;
+
+// Call once, right after MPI_Init
+static inline void mpi_trace_init(MPI_Comm comm)
+{
+    MPI_Comm_rank(comm, &mpi_trace.rank);
+    mpi_trace.origin = MPI_Wtime();
+    mpi_trace.path = getenv("MPI_TRACE");
+    if (mpi_trace.path != NULL && mpi_trace.path[0] == '\0')
+        mpi_trace.path = NULL;
+}
+
+static inline double mpi_trace_begin(void)
+{
+    mpi_trace.depth++;
+    return MPI_Wtime();
+}
+
+static inline void mpi_trace_end(MpiTraceKind kind, const char *name, double start)
+{
+    double end = MPI_Wtime();
+    if (--mpi_trace.depth == 0)
+        mpi_trace.total[kind] += end - start;
+
+    if (mpi_trace.path == NULL)
+        return;
+    if (mpi_trace.count == mpi_trace.capacity)
+    {
+        mpi_trace.capacity = mpi_trace.capacity ? 2 * mpi_trace.capacity : 256;
+        mpi_trace.events = realloc(mpi_trace.events, sizeof(MpiTraceEvent) * mpi_trace.capacity);
+    }
+    MpiTraceEvent *e = &mpi_trace.events[mpi_trace.count++];
+    e->name = name;
+    e->kind = kind;
+    e->start = start;
+    e->end = end;
+}
+
+#define MPI_TRACE_SCOPE(kind, name)                                                   \
+    for (double mpi_trace_start_ = mpi_trace_begin(), mpi_trace_once_ = 1; mpi_trace_once_; \
+         mpi_trace_once_ = 0, mpi_trace_end((kind), (name), mpi_trace_start_))
+
+// Write this rank's events as Chrome trace events (microseconds since mpi_trace_init)
+static inline void mpi_trace_write_timeline(void)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s.%d.json", mpi_trace.path, mpi_trace.rank);
+    FILE *f = fopen(path, "w");
+    if (f == NULL)
+        return;
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"rank %d\"}}",
+            mpi_trace.rank, mpi_trace.rank);
+    for (int i = 0; i < mpi_trace.count; i++)
+    {
+        const MpiTraceEvent *e = &mpi_trace.events[i];
+        fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f}",
+                e->name, MPI_TRACE_KIND_NAMES[e->kind], mpi_trace.rank, (e->start - mpi_trace.origin) * 1e6,
+                (e->end - e->start) * 1e6);
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+}
+
+// Collective over comm: print the min/avg/max table to out on rank 0, write the timelines
+// and release the event buffer
+static inline void mpi_trace_report(MPI_Comm comm, FILE *out)
+{
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    double local[MPI_TRACE_KINDS + 1], min[MPI_TRACE_KINDS + 1], max[MPI_TRACE_KINDS + 1], sum[MPI_TRACE_KINDS + 1];
+    for (int k = 0; k < MPI_TRACE_KINDS; k++)
+        local[k] = mpi_trace.total[k];
+    local[MPI_TRACE_KINDS] = MPI_Wtime() - mpi_trace.origin;
+
+    MPI_Reduce(local, min, MPI_TRACE_KINDS + 1, MPI_DOUBLE, MPI_MIN, 0, comm);
+    MPI_Reduce(local, max, MPI_TRACE_KINDS + 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+    MPI_Reduce(local, sum, MPI_TRACE_KINDS + 1, MPI_DOUBLE, MPI_SUM, 0, comm);
+
+    if (rank == 0)
+    {
+        fprintf(out, "Per-rank time over %d rank(s)   Min(s)    Avg(s)    Max(s)   Imbalance (max/avg)\n", size);
+        for (int k = 0; k <= MPI_TRACE_KINDS; k++)
+        {
+            double avg = sum[k] / size;
+            fprintf(out, "  %-28s %8.4f  %8.4f  %8.4f   %.3f\n", k < MPI_TRACE_KINDS ? MPI_TRACE_KIND_NAMES[k] : "wall",
+                    min[k], avg, max[k], avg > 0 ? max[k] / avg : 1.0);
+        }
+        if (mpi_trace.path != NULL)
+            fprintf(out, "Timeline: %s.<rank>.json\n", mpi_trace.path);
+    }
+
+    if (mpi_trace.path != NULL)
+        mpi_trace_write_timeline();
+    free(mpi_trace.events);
+    mpi_trace.events = NULL;
+    mpi_trace.count = mpi_trace.capacity = 0;
+}
+
+#endif
@@ -0,0 +1,240 @@
+// perf_counters.h
+// Optional hardware counters around compute phases, through Linux perf_event_open(2).
+//
+// Each thread (or rank) opens its own set with perf_counters_open(), which counts only the
+// calling thread in user space, and brackets a phase with perf_counters_start() /
+// perf_counters_stop(). Events: cycles, instructions, branch misses, L1D read misses and
+// last-level cache misses; together they tell division latency (low IPC, few misses) from
+// mispredicts and cache traffic. Every event is opened on its own, so a PMU that lacks one
+// still reports the rest. An event that cannot be opened (no PMU in a VM or container,
+// kernel.perf_event_paranoid too high, no kernel support) reads as -1 and prints as n/a;
+// when none can be opened, perf_counters_unavailable() says why and the program runs on
+// unchanged. Values are scaled up when the kernel had to multiplex the counters.
+// With mpi.h included first, perf_counters_report_mpi() adds a min/avg/max-over-ranks table.
+//
+// Header-only; include with #include "../common/perf_counters.h".
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define PERF_COUNTERS_EVENTS 5
+
+enum
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES
+};
+
+typedef struct
+{
+    int fd[PERF_COUNTERS_EVENTS]; // -1 where the event is not available
+    int opened;                   // events perf_counters_open() managed to open
+    int open_errno;               // first failure, 0 if every event opened
+} PerfCounters;
+
+static inline void perf_counters_attr(int event, struct perf_event_attr *attr)
+{
+    memset(attr, 0, sizeof(*attr));
+    attr->size = sizeof(*attr);
+    attr->disabled = 1;
+    attr->exclude_kernel = 1;
+    attr->exclude_hv = 1;
+    attr->read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    attr->type = PERF_TYPE_HARDWARE;
+    switch (event)
+    {
+    case PERF_CYCLES:
+        attr->config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case PERF_INSTRUCTIONS:
+        attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case PERF_BRANCH_MISSES:
+        attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    case PERF_L1D_MISSES:
+        attr->type = PERF_TYPE_HW_CACHE;
+        attr->config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                       (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    default:
+        attr->config = PERF_COUNT_HW_CACHE_MISSES; // the kernel maps this to last-level misses
+        break;
+    }
+}
+
+// Open the events for the calling thread, stopped; returns how many could be opened
+static inline int perf_counters_open(PerfCounters *pc)
+{
+    pc->opened = 0;
+    pc->open_errno = 0;
+    for (int i = 0; i < PERF_COUNTERS_EVENTS; i++)
+    {
+        struct perf_event_attr attr;
+        perf_counters_attr(i, &attr);
+        pc->fd[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (pc->fd[i] >= 0)
+            pc->opened++;
+        else if (pc->open_errno == 0)
+            pc->open_errno = errno;
+    }
+    return pc->opened;
+}
+
+static inline void perf_counters_close(PerfCounters *pc)
+{
+    for (int i = 0; i < PERF_COUNTERS_EVENTS; i++)
+    {
+        if (pc->fd[i] >= 0)
+            close(pc->fd[i]);
+        pc->fd[i] = -1;
+    }
+}
+
+static inline void perf_counters_start(const PerfCounters *pc)
+{
+    for (int i = 0; i < PERF_COUNTERS_EVENTS; i++)
+    {
+        if (pc->fd[i] >= 0)
+        {
+            ioctl(pc->fd[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(pc->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+// Stop counting and add the counts since perf_counters_start() to values (-1 stays -1)
+static inline void perf_counters_stop(const PerfCounters *pc, long long *values)
+{
+    for (int i = 0; i < PERF_COUNTERS_EVENTS; i++)
+    {
+        if (pc->fd[i] < 0)
+        {
+            values[i] = -1;
+            continue;
+        }
+        ioctl(pc->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+        unsigned long long data[3]; // value, time enabled, time running
+        if (read(pc->fd[i], data, sizeof(data)) != (ssize_t)sizeof(data))
+        {
+            values[i] = -1;
+            continue;
+        }
+        double scaled = (double)data[0];
+        if (data[2] > 0 && data[2] < data[1])
+            scaled *= (double)data[1] / data[2];
+        if (values[i] >= 0)
+            values[i] += (long long)scaled;
+    }
+}
+
+// total += v, event by event; n/a in either makes the total n/a
+static inline void perf_counters_add(long long *total, const long long *v)
+{
+    for (int i = 0; i < PERF_COUNTERS_EVENTS; i++)
+        total[i] = (total[i] < 0 || v[i] < 0) ? -1 : total[i] + v[i];
+}
+
+// Why nothing could be counted, or NULL if at least one event opened (also after close)
+static inline const char *perf_counters_unavailable(const PerfCounters *pc, char *buf, int len)
+{
+    if (pc->opened > 0)
+        return NULL;
+    int paranoid = -9;
+    FILE *f = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+    if (f != NULL)
+    {
+        if (fscanf(f, "%d", &paranoid) != 1)
+            paranoid = -9;
+        fclose(f);
+    }
+    if (paranoid != -9)
+        snprintf(buf, len, "perf_event_open: %s; kernel.perf_event_paranoid = %d", strerror(pc->open_errno), paranoid);
+    else
+        snprintf(buf, len, "perf_event_open: %s", strerror(pc->open_errno));
+    return buf;
+}
+
+static inline void perf_counters_header(FILE *out, const char *label)
+{
+    fprintf(out, "%-10s %14s %14s  %5s %12s %12s %12s\n", label, "Cycles", "Instructions", "IPC", "Br-misses",
+            "L1D-misses", "LLC-misses");
+}
+
+// One row: the five counts and instructions per cycle, n/a where an event is missing
+static inline void perf_counters_row(FILE *out, const char *label, const long long *v)
+{
+    static const int width[PERF_COUNTERS_EVENTS] = {14, 14, 12, 12, 12};
+    fprintf(out, "%-10s", label);
+    for (int i = 0; i < PERF_COUNTERS_EVENTS; i++)
+    {
+        if (i == PERF_BRANCH_MISSES)
+        {
+            if (v[PERF_CYCLES] > 0 && v[PERF_INSTRUCTIONS] >= 0)
+                fprintf(out, "  %5.2f", (double)v[PERF_INSTRUCTIONS] / v[PERF_CYCLES]);
+            else
+                fprintf(out, "  %5s", "n/a");
+        }
+        if (v[i] >= 0)
+            fprintf(out, " %*lld", width[i], v[i]);
+        else
+            fprintf(out, " %*s", width[i], "n/a");
+    }
+    fprintf(out, "\n");
+}
+
+#ifdef MPI_VERSION
+// Collective over comm: min/avg/max of each rank's counts, printed to out on rank 0. An
+// event missing on any rank prints as n/a; if no rank could count at all, one line says so.
+static inline void perf_counters_report_mpi(const PerfCounters *pc, const long long *values, const char *phase,
+                                            MPI_Comm comm, FILE *out)
+{
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    long long min[PERF_COUNTERS_EVENTS], max[PERF_COUNTERS_EVENTS], sum[PERF_COUNTERS_EVENTS];
+    MPI_Reduce(values, min, PERF_COUNTERS_EVENTS, MPI_LONG_LONG, MPI_MIN, 0, comm);
+    MPI_Reduce(values, max, PERF_COUNTERS_EVENTS, MPI_LONG_LONG, MPI_MAX, 0, comm);
+    MPI_Reduce(values, sum, PERF_COUNTERS_EVENTS, MPI_LONG_LONG, MPI_SUM, 0, comm);
+    if (rank != 0)
+        return;
+
+    int any = 0;
+    long long avg[PERF_COUNTERS_EVENTS];
+    for (int i = 0; i < PERF_COUNTERS_EVENTS; i++)
+    {
+        if (min[i] < 0)
+            min[i] = max[i] = sum[i] = -1;
+        avg[i] = min[i] < 0 ? -1 : sum[i] / size;
+        any |= min[i] >= 0;
+    }
+    if (!any)
+    {
+        char reason[160];
+        fprintf(out, "Perf counters:         unavailable (%s)\n",
+                perf_counters_unavailable(pc, reason, sizeof(reason)) ? reason : "not on every rank");
+        return;
+    }
+    fprintf(out, "Perf counters, %s, over %d rank(s):\n", phase, size);
+    perf_counters_header(out, "");
+    perf_counters_row(out, "  min", min);
+    perf_counters_row(out, "  avg", avg);
+    perf_counters_row(out, "  max", max);
+    perf_counters_row(out, "  total", sum);
+}
+#endif
+
+#endif
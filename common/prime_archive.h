@@ -0,0 +1,260 @@
+// prime_archive.h
+// Compact binary prime archive: a writer and an mmap-based reader.
+//
+// Layout (all integers little-endian, as written by the host):
+//   header   PrimeArchiveHeader, 64 bytes
+//   index    num_blocks x PrimeArchiveBlock (first prime + byte offset of the block's data)
+//   data     per block: the gaps between consecutive primes as LEB128 varints
+//
+// Block k holds primes k*block_size .. (k+1)*block_size - 1; its first prime lives in the
+// index, so the data only carries block_size - 1 gaps. Almost every gap is below 128 and
+// takes one byte, against about 10 bytes per prime in primes_mpi.txt. Random access only
+// decodes a single block: the k-th prime is a direct index lookup, and a range [a, b] is
+// a binary search over the index followed by a forward scan.
+//
+// Header-only; include with #include "../common/prime_archive.h".
+
+#ifndef PRIME_ARCHIVE_H
+#define PRIME_ARCHIVE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define PRIME_ARCHIVE_MAGIC "PRIMEARC"
+#define PRIME_ARCHIVE_VERSION 1
+#define PRIME_ARCHIVE_BLOCK_SIZE 256 // primes per block (16 index bytes per block)
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t block_size;   // primes per block
+    uint64_t n;            // the archive holds every prime below n
+    uint64_t count;        // number of primes stored
+    uint64_t num_blocks;
+    uint64_t index_offset; // from the start of the file
+    uint64_t data_offset;  // from the start of the file
+    uint64_t data_size;    // bytes
+} PrimeArchiveHeader;
+
+typedef struct
+{
+    uint64_t first;  // first prime of the block
+    uint64_t offset; // start of the block's gaps, relative to data_offset
+} PrimeArchiveBlock;
+
+/* ---------------------------------------------------------------- writer */
+
+typedef struct
+{
+    FILE *f;
+    PrimeArchiveHeader header;
+    PrimeArchiveBlock *index;
+    uint64_t index_capacity;
+    uint64_t last;   // previous prime written
+    uint64_t offset; // data bytes written so far
+} PrimeArchiveWriter;
+
+// Index is written after the data once the block count is known, so the data
+// starts right after the header.
+static inline int prime_archive_create(PrimeArchiveWriter *w, const char *path)
+{
+    memset(w, 0, sizeof(*w));
+    w->f = fopen(path, "wb");
+    if (w->f == NULL)
+        return -1;
+
+    memcpy(w->header.magic, PRIME_ARCHIVE_MAGIC, 8);
+    w->header.version = PRIME_ARCHIVE_VERSION;
+    w->header.block_size = PRIME_ARCHIVE_BLOCK_SIZE;
+    w->header.data_offset = sizeof(PrimeArchiveHeader);
+    w->index_capacity = 64;
+    w->index = malloc(w->index_capacity * sizeof(PrimeArchiveBlock));
+
+    // Placeholder, rewritten by prime_archive_finish
+    fwrite(&w->header, sizeof(w->header), 1, w->f);
+    return 0;
+}
+
+// Primes must be appended in increasing order
+static inline void prime_archive_append(PrimeArchiveWriter *w, uint64_t p)
+{
+    if (w->header.count % w->header.block_size == 0)
+    {
+        if (w->header.num_blocks == w->index_capacity)
+        {
+            w->index_capacity *= 2;
+            w->index = realloc(w->index, w->index_capacity * sizeof(PrimeArchiveBlock));
+        }
+        w->index[w->header.num_blocks].first = p;
+        w->index[w->header.num_blocks].offset = w->offset;
+        w->header.num_blocks++;
+    }
+    else
+    {
+        unsigned char buf[10];
+        int len = 0;
+        uint64_t gap = p - w->last;
+        do
+        {
+            buf[len++] = (unsigned char)((gap & 0x7F) | (gap >= 0x80 ? 0x80 : 0));
+            gap >>= 7;
+        } while (gap > 0);
+        fwrite(buf, 1, len, w->f);
+        w->offset += len;
+    }
+    w->last = p;
+    w->header.count++;
+}
+
+// Write the index and the final header; n is the (exclusive) bound the primes were taken below
+static inline int prime_archive_finish(PrimeArchiveWriter *w, uint64_t n)
+{
+    w->header.n = n;
+    w->header.data_size = w->offset;
+    w->header.index_offset = w->header.data_offset + w->offset;
+    fwrite(w->index, sizeof(PrimeArchiveBlock), w->header.num_blocks, w->f);
+
+    fseek(w->f, 0, SEEK_SET);
+    fwrite(&w->header, sizeof(w->header), 1, w->f);
+    int err = ferror(w->f);
+    fclose(w->f);
+    free(w->index);
+    return err ? -1 : 0;
+}
+
+/* ---------------------------------------------------------------- reader */
+
+typedef struct
+{
+    const unsigned char *map;
+    size_t size;
+    const PrimeArchiveHeader *header;
+    const PrimeArchiveBlock *index;
+    const unsigned char *data;
+} PrimeArchive;
+
+// Map an archive read-only; returns 0 on success, -1 if it is missing or malformed
+static inline int prime_archive_open(PrimeArchive *ar, const char *path)
+{
+    memset(ar, 0, sizeof(*ar));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(PrimeArchiveHeader))
+    {
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    ar->map = map;
+    ar->size = st.st_size;
+    ar->header = (const PrimeArchiveHeader *)ar->map;
+    if (memcmp(ar->header->magic, PRIME_ARCHIVE_MAGIC, 8) != 0 ||
+        ar->header->version != PRIME_ARCHIVE_VERSION ||
+        ar->header->index_offset + ar->header->num_blocks * sizeof(PrimeArchiveBlock) > ar->size)
+    {
+        munmap(map, st.st_size);
+        memset(ar, 0, sizeof(*ar));
+        return -1;
+    }
+    ar->index = (const PrimeArchiveBlock *)(ar->map + ar->header->index_offset);
+    ar->data = ar->map + ar->header->data_offset;
+    return 0;
+}
+
+static inline void prime_archive_close(PrimeArchive *ar)
+{
+    if (ar->map != NULL)
+        munmap((void *)ar->map, ar->size);
+    memset(ar, 0, sizeof(*ar));
+}
+
+static inline uint64_t prime_archive_read_gap(const unsigned char **p)
+{
+    uint64_t gap = 0;
+    int shift = 0;
+    unsigned char byte;
+    do
+    {
+        byte = *(*p)++;
+        gap |= (uint64_t)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return gap;
+}
+
+// The k-th prime (0-based, so k = 0 gives 2), or 0 if k is out of range
+static inline uint64_t prime_archive_nth(const PrimeArchive *ar, uint64_t k)
+{
+    if (k >= ar->header->count)
+        return 0;
+    uint64_t block = k / ar->header->block_size;
+    const unsigned char *p = ar->data + ar->index[block].offset;
+    uint64_t prime = ar->index[block].first;
+    for (uint64_t i = block * ar->header->block_size; i < k; i++)
+        prime += prime_archive_read_gap(&p);
+    return prime;
+}
+
+// Visit the primes in [a, b] in order; out may be NULL to only count them.
+// Writes at most cap primes to out and returns how many primes lie in the range.
+static inline uint64_t prime_archive_range(const PrimeArchive *ar, uint64_t a, uint64_t b,
+                                           uint64_t *out, uint64_t cap)
+{
+    uint64_t blocks = ar->header->num_blocks;
+    if (blocks == 0 || a > b)
+        return 0;
+
+    // Last block whose first prime is <= a (or block 0)
+    uint64_t lo = 0, hi = blocks;
+    while (hi - lo > 1)
+    {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (ar->index[mid].first <= a)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    uint64_t found = 0;
+    for (uint64_t block = lo; block < blocks; block++)
+    {
+        const unsigned char *p = ar->data + ar->index[block].offset;
+        uint64_t prime = ar->index[block].first;
+        uint64_t first = block * ar->header->block_size;
+        uint64_t last = first + ar->header->block_size;
+        if (last > ar->header->count)
+            last = ar->header->count;
+
+        for (uint64_t i = first; i < last; i++)
+        {
+            if (i > first)
+                prime += prime_archive_read_gap(&p);
+            if (prime > b)
+                return found;
+            if (prime >= a)
+            {
+                if (out != NULL && found < cap)
+                    out[found] = prime;
+                found++;
+            }
+        }
+    }
+    return found;
+}
+
+#endif
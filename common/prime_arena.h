@@ -0,0 +1,137 @@
+// prime_arena.h
+// Growable result buffer for prime lists: a chain of fixed-size blocks.
+//
+// Appending never reallocates or copies; when the last block is full a new one is linked
+// on, so memory follows the number of primes actually found (plus at most one partly
+// filled block) instead of an up-front guess. Kernels that write a run of values at once
+// (prime_batch_range, prime_sieve_range) take a pointer from prime_arena_reserve() and
+// report how many they used with prime_arena_commit(); a reservation that does not fit
+// the last block starts a new one, so keep reservations well below PRIME_ARENA_BLOCK.
+// The values stay in append order across blocks. prime_arena_copy() flattens them, and
+// with mpi.h included first, prime_arena_mpi_type() describes the blocks in place so the
+// arena can be sent from MPI_BOTTOM (e.g. as the send buffer of MPI_Gatherv) without a copy.
+//
+// Header-only; include with #include "../common/prime_arena.h".
+
+#ifndef PRIME_ARENA_H
+#define PRIME_ARENA_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#define PRIME_ARENA_BLOCK 262144 // ints per block (1 MiB)
+
+typedef struct PrimeArenaBlock
+{
+    struct PrimeArenaBlock *next;
+    int count;
+    int values[PRIME_ARENA_BLOCK];
+} PrimeArenaBlock;
+
+typedef struct
+{
+    PrimeArenaBlock *head;
+    PrimeArenaBlock *tail;
+    long long count; // values in all blocks
+    int blocks;
+} PrimeArena;
+
+static inline void prime_arena_init(PrimeArena *a)
+{
+    memset(a, 0, sizeof(*a));
+}
+
+static inline void prime_arena_free(PrimeArena *a)
+{
+    while (a->head != NULL)
+    {
+        PrimeArenaBlock *next = a->head->next;
+        free(a->head);
+        a->head = next;
+    }
+    prime_arena_init(a);
+}
+
+// Room for at least k (<= PRIME_ARENA_BLOCK) values at the end of the arena
+static inline int *prime_arena_reserve(PrimeArena *a, int k)
+{
+    if (a->tail == NULL || PRIME_ARENA_BLOCK - a->tail->count < k)
+    {
+        PrimeArenaBlock *b = malloc(sizeof(PrimeArenaBlock));
+        b->next = NULL;
+        b->count = 0;
+        if (a->tail != NULL)
+            a->tail->next = b;
+        else
+            a->head = b;
+        a->tail = b;
+        a->blocks++;
+    }
+    return a->tail->values + a->tail->count;
+}
+
+// Keep the first used values written to the last reservation
+static inline void prime_arena_commit(PrimeArena *a, int used)
+{
+    a->tail->count += used;
+    a->count += used;
+}
+
+static inline void prime_arena_push(PrimeArena *a, int v)
+{
+    *prime_arena_reserve(a, 1) = v;
+    prime_arena_commit(a, 1);
+}
+
+// Copy every value, in order, to dst (room for a->count ints); returns dst + a->count
+static inline int *prime_arena_copy(const PrimeArena *a, int *dst)
+{
+    for (const PrimeArenaBlock *b = a->head; b != NULL; b = b->next)
+    {
+        memcpy(dst, b->values, sizeof(int) * b->count);
+        dst += b->count;
+    }
+    return dst;
+}
+
+// Bytes held by the arena's blocks
+static inline long long prime_arena_bytes(const PrimeArena *a)
+{
+    return (long long)a->blocks * sizeof(PrimeArenaBlock);
+}
+
+// Peak resident set size of this process so far, in KiB (getrusage's ru_maxrss on Linux)
+static inline long prime_peak_rss_kb(void)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return usage.ru_maxrss;
+}
+
+#ifdef MPI_VERSION
+// A datatype covering the arena's a->count ints at their absolute addresses: send one
+// element of it from MPI_BOTTOM. Free it with MPI_Type_free.
+static inline MPI_Datatype prime_arena_mpi_type(const PrimeArena *a)
+{
+    int *lengths = malloc(sizeof(int) * (a->blocks + 1));
+    MPI_Aint *displs = malloc(sizeof(MPI_Aint) * (a->blocks + 1));
+    int n = 0;
+    for (const PrimeArenaBlock *b = a->head; b != NULL; b = b->next)
+    {
+        lengths[n] = b->count;
+        MPI_Get_address(b->values, &displs[n]);
+        n++;
+    }
+
+    MPI_Datatype type;
+    MPI_Type_create_hindexed(n, lengths, displs, MPI_INT, &type);
+    MPI_Type_commit(&type);
+    free(lengths);
+    free(displs);
+    return type;
+}
+#endif
+
+#endif
@@ -0,0 +1,238 @@
+// prime_batch.h
+// Batch trial-division primality test for 32-bit candidates, without hardware division.
+//
+// For every odd base prime p we precompute its inverse modulo 2^32 and the bound
+// floor((2^32 - 1) / p). Then p divides n exactly when n * inverse (mod 2^32) <= bound,
+// one multiply and one compare (Granlund-Montgomery; the same precomputed-reciprocal
+// idea as Lemire's fastmod, but it only needs a 32-bit low multiply). That maps onto
+// vpmulld, so AVX2 tests 8 candidates per instruction and AVX-512 tests 16. The vector
+// kernels are compiled with target attributes and picked at run time, so the same binary
+// falls back to the scalar loop on CPUs without AVX2.
+//
+// Header-only; include with #include "../common/prime_batch.h".
+
+#ifndef PRIME_BATCH_H
+#define PRIME_BATCH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PRIME_BATCH_X86 1
+#endif
+
+#define PRIME_BATCH_WIDTH 16 // candidates per batch call
+
+// Which kernel prime_batch uses on this CPU: 512, 256 or 0 (scalar)
+static inline int prime_batch_isa(void)
+{
+#ifdef PRIME_BATCH_X86
+    if (__builtin_cpu_supports("avx512f"))
+        return 512;
+    if (__builtin_cpu_supports("avx2"))
+        return 256;
+#endif
+    return 0;
+}
+
+typedef struct
+{
+    int isa; // prime_batch_isa(), detected once by prime_divisors_init; threads only read it
+    int count;
+    uint32_t *primes;  // odd primes, ascending
+    uint32_t *inverse; // primes[i]^-1 mod 2^32
+    uint32_t *bound;   // (2^32 - 1) / primes[i]
+} PrimeDivisors;
+
+// Odd primes up to sqrt(max_n), with their reciprocals
+static inline void prime_divisors_init(PrimeDivisors *d, uint32_t max_n)
+{
+    uint32_t limit = (uint32_t)sqrt((double)max_n) + 1;
+    char *composite = calloc(limit + 1, 1);
+    d->primes = malloc(sizeof(uint32_t) * (limit / 2 + 2));
+    d->inverse = malloc(sizeof(uint32_t) * (limit / 2 + 2));
+    d->bound = malloc(sizeof(uint32_t) * (limit / 2 + 2));
+    d->count = 0;
+    d->isa = prime_batch_isa();
+
+    for (uint32_t i = 3; i <= limit; i += 2)
+    {
+        if (composite[i])
+            continue;
+        for (uint64_t j = (uint64_t)i * i; j <= limit; j += 2 * i)
+            composite[j] = 1;
+
+        uint32_t inv = i; // correct to 3 bits for odd i; each Newton step doubles that
+        for (int k = 0; k < 4; k++)
+            inv *= 2 - i * inv;
+        d->primes[d->count] = i;
+        d->inverse[d->count] = inv;
+        d->bound[d->count] = UINT32_MAX / i;
+        d->count++;
+    }
+    free(composite);
+}
+
+static inline void prime_divisors_free(PrimeDivisors *d)
+{
+    free(d->primes);
+    free(d->inverse);
+    free(d->bound);
+}
+
+// Single candidate; d must cover sqrt(n)
+static inline int prime_test_scalar(const PrimeDivisors *d, uint32_t n)
+{
+    if (n < 2)
+        return 0;
+    if ((n & 1) == 0)
+        return n == 2;
+    for (int i = 0; i < d->count; i++)
+    {
+        uint32_t p = d->primes[i];
+        if ((uint64_t)p * p > n)
+            break;
+        if (n * d->inverse[i] <= d->bound[i])
+            return 0;
+    }
+    return 1;
+}
+
+static inline void prime_batch_scalar(const PrimeDivisors *d, const uint32_t *n, int count, unsigned char *out)
+{
+    for (int j = 0; j < count; j++)
+        out[j] = (unsigned char)prime_test_scalar(d, n[j]);
+}
+
+#ifdef PRIME_BATCH_X86
+
+// Lanes that can only be settled without the divisor loop: n < 2 and even n
+static inline uint32_t prime_batch_trivial(const uint32_t *n, int lanes, uint32_t *alive, uint32_t *max_n)
+{
+    uint32_t mask = 0, hi = 0;
+    for (int j = 0; j < lanes; j++)
+    {
+        if (n[j] >= 3 && (n[j] & 1))
+        {
+            mask |= 1u << j;
+            if (n[j] > hi)
+                hi = n[j];
+        }
+    }
+    *alive = mask;
+    *max_n = hi;
+    return mask;
+}
+
+__attribute__((target("avx2"))) static inline void prime_batch_avx2(const PrimeDivisors *d, const uint32_t *n, int count,
+                                                                    unsigned char *out)
+{
+    for (int base = 0; base < count; base += 8)
+    {
+        int lanes = count - base < 8 ? count - base : 8;
+        uint32_t buf[8] = {0};
+        for (int j = 0; j < lanes; j++)
+            buf[j] = n[base + j];
+
+        uint32_t alive, max_n;
+        prime_batch_trivial(buf, 8, &alive, &max_n);
+
+        __m256i v = _mm256_loadu_si256((const __m256i *)buf);
+        for (int i = 0; i < d->count && alive; i++)
+        {
+            uint32_t p = d->primes[i];
+            if ((uint64_t)p * p > max_n)
+                break;
+            __m256i prod = _mm256_mullo_epi32(v, _mm256_set1_epi32((int)d->inverse[i]));
+            __m256i bound = _mm256_set1_epi32((int)d->bound[i]);
+            __m256i divisible = _mm256_cmpeq_epi32(_mm256_min_epu32(prod, bound), prod); // prod <= bound
+            __m256i itself = _mm256_cmpeq_epi32(v, _mm256_set1_epi32((int)p));
+            uint32_t hit = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_andnot_si256(itself, divisible)));
+            alive &= ~hit;
+        }
+
+        for (int j = 0; j < lanes; j++)
+            out[base + j] = (unsigned char)(((alive >> j) & 1) || buf[j] == 2);
+    }
+}
+
+__attribute__((target("avx512f"))) static inline void prime_batch_avx512(const PrimeDivisors *d, const uint32_t *n, int count,
+                                                                         unsigned char *out)
+{
+    for (int base = 0; base < count; base += 16)
+    {
+        int lanes = count - base < 16 ? count - base : 16;
+        uint32_t buf[16] = {0};
+        for (int j = 0; j < lanes; j++)
+            buf[j] = n[base + j];
+
+        uint32_t alive, max_n;
+        prime_batch_trivial(buf, 16, &alive, &max_n);
+
+        __m512i v = _mm512_loadu_si512((const void *)buf);
+        for (int i = 0; i < d->count && alive; i++)
+        {
+            uint32_t p = d->primes[i];
+            if ((uint64_t)p * p > max_n)
+                break;
+            __m512i prod = _mm512_mullo_epi32(v, _mm512_set1_epi32((int)d->inverse[i]));
+            __mmask16 divisible = _mm512_cmple_epu32_mask(prod, _mm512_set1_epi32((int)d->bound[i]));
+            __mmask16 other = _mm512_cmpneq_epu32_mask(v, _mm512_set1_epi32((int)p));
+            alive &= ~(uint32_t)(divisible & other);
+        }
+
+        for (int j = 0; j < lanes; j++)
+            out[base + j] = (unsigned char)(((alive >> j) & 1) || buf[j] == 2);
+    }
+}
+
+#endif
+
+// out[j] = 1 if n[j] is prime; d must cover sqrt(max n[j])
+static inline void prime_batch(const PrimeDivisors *d, const uint32_t *n, int count, unsigned char *out)
+{
+#ifdef PRIME_BATCH_X86
+    if (d->isa == 512)
+    {
+        prime_batch_avx512(d, n, count, out);
+        return;
+    }
+    if (d->isa == 256)
+    {
+        prime_batch_avx2(d, n, count, out);
+        return;
+    }
+#endif
+    prime_batch_scalar(d, n, count, out);
+}
+
+// Append every prime in [lo, hi) to out (values must fit in an int); returns how many
+static inline int prime_batch_range(const PrimeDivisors *d, uint32_t lo, uint32_t hi, int *out)
+{
+    uint32_t n[PRIME_BATCH_WIDTH];
+    unsigned char is_prime[PRIME_BATCH_WIDTH];
+    int found = 0;
+
+    if (lo <= 2 && hi > 2)
+        out[found++] = 2;
+    uint32_t k = lo < 3 ? 3 : (lo | 1); // odd candidates only
+    while (k < hi)
+    {
+        int lanes = 0;
+        for (; lanes < PRIME_BATCH_WIDTH && k < hi; lanes++, k += 2)
+            n[lanes] = k;
+        prime_batch(d, n, lanes, is_prime);
+        for (int j = 0; j < lanes; j++)
+        {
+            if (is_prime[j])
+                out[found++] = (int)n[j];
+        }
+        if (k < n[lanes - 1]) // wrapped past 2^32
+            break;
+    }
+    return found;
+}
+
+#endif
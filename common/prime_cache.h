@@ -0,0 +1,181 @@
+// prime_cache.h
+// Persistent on-disk cache of sieved mod-30 wheel segments (see wheel30.h).
+//
+// The number line is cut into fixed segments of PRIME_CACHE_SEGMENT_BYTES wheel bytes
+// (30 numbers per byte). Segment k lives in <dir>/seg_<k>.w30: a PrimeCacheHeader
+// followed by the segment's bitset. The header repeats the segment index and size and
+// carries an FNV-1a checksum of the bitset, so a truncated, foreign or corrupted file is
+// detected and simply sieved again. Segments are always sieved whole, even when the caller
+// only needs part of one, so a run with a larger n only sieves the segments past the
+// previous end. Files are written under a temporary name and renamed into place, so
+// several processes filling the same segment never see a half-written file.
+//
+// Header-only; include with #include "../common/prime_cache.h".
+
+#ifndef PRIME_CACHE_H
+#define PRIME_CACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "prime_kernel.h"
+
+#define PRIME_CACHE_MAGIC "PRIMESEG"
+#define PRIME_CACHE_VERSION 1
+#define PRIME_CACHE_SEGMENT_BYTES 131072 // wheel bytes per segment file (3,932,160 numbers)
+#define PRIME_CACHE_DEFAULT_DIR "prime_cache"
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t segment_bytes;
+    uint64_t index;    // segment k covers wheel bytes [k, k + 1) * segment_bytes
+    uint64_t checksum; // prime_cache_checksum of the bitset
+} PrimeCacheHeader;
+
+typedef struct
+{
+    char dir[256];
+    int *base_primes; // every prime up to sqrt of the end of the last segment
+    int base_count;
+} PrimeCache;
+
+typedef struct
+{
+    long long loaded;   // segments mapped from disk
+    long long sieved;   // segments sieved (and stored) because they were missing
+    long long rejected; // files present but failing validation, sieved again
+} PrimeCacheStats;
+
+// FNV-1a over 64-bit words (nbytes is a multiple of 8), eight times fewer multiplies than bytewise
+static inline uint64_t prime_cache_checksum(const unsigned char *bits, long long nbytes)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (long long i = 0; i < nbytes; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, bits + i, 8);
+        h = (h ^ word) * 1099511628211ULL;
+    }
+    return h;
+}
+
+// Ready the cache in dir (PRIME_CACHE_DIR or PRIME_CACHE_DEFAULT_DIR if NULL) for primes below n
+static inline void prime_cache_open(PrimeCache *c, const char *dir, long long n)
+{
+    if (dir == NULL)
+        dir = getenv("PRIME_CACHE_DIR") ? getenv("PRIME_CACHE_DIR") : PRIME_CACHE_DEFAULT_DIR;
+    snprintf(c->dir, sizeof(c->dir), "%s", dir);
+    mkdir(c->dir, 0755); // fine if it already exists
+
+    long long segments = (wheel30_bytes(n) + PRIME_CACHE_SEGMENT_BYTES - 1) / PRIME_CACHE_SEGMENT_BYTES;
+    long long end = 30LL * PRIME_CACHE_SEGMENT_BYTES * (segments > 0 ? segments : 1);
+    c->base_primes = prime_sieve_small((int)sqrt((double)end) + 1, &c->base_count);
+}
+
+static inline void prime_cache_close(PrimeCache *c)
+{
+    free(c->base_primes);
+}
+
+// Copy segment k's bitset into out if its file is present and valid; 1 on success,
+// 0 if missing, -1 if present but invalid
+static inline int prime_cache_load(const PrimeCache *c, long long k, unsigned char *out)
+{
+    char path[320];
+    snprintf(path, sizeof(path), "%s/seg_%lld.w30", c->dir, k);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    size_t size = sizeof(PrimeCacheHeader) + PRIME_CACHE_SEGMENT_BYTES;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size != size)
+    {
+        close(fd);
+        return -1;
+    }
+    const unsigned char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    const PrimeCacheHeader *h = (const PrimeCacheHeader *)map;
+    const unsigned char *bits = map + sizeof(PrimeCacheHeader);
+    int ok = memcmp(h->magic, PRIME_CACHE_MAGIC, 8) == 0 && h->version == PRIME_CACHE_VERSION &&
+             h->segment_bytes == PRIME_CACHE_SEGMENT_BYTES && h->index == (uint64_t)k &&
+             h->checksum == prime_cache_checksum(bits, PRIME_CACHE_SEGMENT_BYTES);
+    if (ok)
+        memcpy(out, bits, PRIME_CACHE_SEGMENT_BYTES);
+    munmap((void *)map, size);
+    return ok ? 1 : -1;
+}
+
+// Write segment k; a failed write only costs a re-sieve next time
+static inline void prime_cache_store(const PrimeCache *c, long long k, const unsigned char *bits)
+{
+    char path[320], tmp[340];
+    snprintf(path, sizeof(path), "%s/seg_%lld.w30", c->dir, k);
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+
+    PrimeCacheHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, PRIME_CACHE_MAGIC, 8);
+    h.version = PRIME_CACHE_VERSION;
+    h.segment_bytes = PRIME_CACHE_SEGMENT_BYTES;
+    h.index = (uint64_t)k;
+    h.checksum = prime_cache_checksum(bits, PRIME_CACHE_SEGMENT_BYTES);
+
+    FILE *f = fopen(tmp, "wb");
+    if (f == NULL)
+        return;
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(bits, 1, PRIME_CACHE_SEGMENT_BYTES, f) == PRIME_CACHE_SEGMENT_BYTES;
+    ok &= fclose(f) == 0;
+    if (!ok || rename(tmp, path) != 0)
+        remove(tmp);
+}
+
+// Fill bits[0 .. byte_hi - byte_lo) with wheel bytes [byte_lo, byte_hi), taking each
+// overlapping segment from the cache or sieving and storing it. Safe to call from several
+// threads or processes at once; stats may be NULL.
+static inline void prime_cache_fill(const PrimeCache *c, unsigned char *bits, long long byte_lo, long long byte_hi,
+                                    PrimeCacheStats *stats)
+{
+    unsigned char *segment = malloc(PRIME_CACHE_SEGMENT_BYTES);
+
+    for (long long k = byte_lo / PRIME_CACHE_SEGMENT_BYTES; k * PRIME_CACHE_SEGMENT_BYTES < byte_hi; k++)
+    {
+        long long seg_lo = k * PRIME_CACHE_SEGMENT_BYTES;
+        long long seg_hi = seg_lo + PRIME_CACHE_SEGMENT_BYTES;
+
+        int status = prime_cache_load(c, k, segment);
+        if (status != 1)
+        {
+            wheel30_sieve(segment, seg_lo, seg_hi, c->base_primes, c->base_count);
+            prime_cache_store(c, k, segment);
+        }
+        if (stats != NULL)
+        {
+            if (status == 1)
+                stats->loaded++;
+            else
+                stats->sieved++;
+            if (status < 0)
+                stats->rejected++;
+        }
+
+        long long lo = seg_lo > byte_lo ? seg_lo : byte_lo;
+        long long hi = seg_hi < byte_hi ? seg_hi : byte_hi;
+        memcpy(bits + (lo - byte_lo), segment + (lo - seg_lo), hi - lo);
+    }
+
+    free(segment);
+}
+
+#endif
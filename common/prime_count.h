@@ -0,0 +1,234 @@
+// prime_count.h
+// Distributed prime counting pi(x) with Meissel's formula, without listing the primes.
+//
+//   pi(x) = phi(x, a) + a - 1 - P2(x, a),   a = pi(x^(1/3)), b = pi(x^(1/2))
+//   P2(x, a) = sum over a < k <= b of (pi(x / p_k) - k + 1)
+//
+// phi(x, a) counts the integers <= x with no prime factor among the first a primes.
+// Its top-level Legendre expansion phi(x, a) = phi(x, 6) - sum_i phi(x / p_i, i) gives
+// independent terms, dealt out cyclically over the ranks. P2 needs pi(v) for v up to
+// x^(2/3); each rank sieves a contiguous block of that range in segments, and an
+// MPI_Exscan of the block totals turns local counts into global ones. Both parts are
+// combined with MPI_Reduce. Every rank holds the pi table and primes up to sqrt(x),
+// plus one sieve segment, so memory is O(sqrt(x)) per rank.
+//
+// Header-only; include with #include "../common/prime_count.h" from an MPI program.
+
+#ifndef PRIME_COUNT_H
+#define PRIME_COUNT_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <mpi.h>
+
+#define PRIME_COUNT_SEGMENT 262144 // numbers per P2 sieve segment
+#define PRIME_COUNT_SMALL_X 1000000 // below this, pi(x) is read straight from the table
+#define PRIME_COUNT_PHI_MOD 30030   // 2*3*5*7*11*13, period of phi(v, 6)
+#define PRIME_COUNT_PHI_TOTIENT 5760 // integers in [1, 30030] coprime to 30030
+
+typedef struct
+{
+    long long limit; // pi[] is valid for 0 .. limit
+    int *pi;         // pi[v] = number of primes <= v
+    int *primes;     // primes[0] = 2, primes[1] = 3, ...
+    int count;
+    int *phi6; // phi6[r] = phi(r, 6) for 0 <= r <= 30030
+} PrimeCountTables;
+
+static inline long long prime_count_isqrt(long long x)
+{
+    long long r = (long long)sqrtl((long double)x);
+    while (r * r > x)
+        r--;
+    while ((r + 1) * (r + 1) <= x)
+        r++;
+    return r;
+}
+
+static inline long long prime_count_icbrt(long long x)
+{
+    long long r = (long long)cbrtl((long double)x);
+    while (r * r * r > x)
+        r--;
+    while ((r + 1) * (r + 1) * (r + 1) <= x)
+        r++;
+    return r;
+}
+
+static inline void prime_count_tables_init(PrimeCountTables *t, long long limit)
+{
+    if (limit < PRIME_COUNT_PHI_MOD)
+        limit = PRIME_COUNT_PHI_MOD;
+    t->limit = limit;
+    t->pi = malloc(sizeof(int) * (limit + 1));
+    t->primes = malloc(sizeof(int) * (limit / 2 + 2));
+    t->count = 0;
+
+    char *composite = calloc(limit + 1, 1);
+    t->pi[0] = t->pi[1] = 0;
+    for (long long i = 2; i <= limit; i++)
+    {
+        if (!composite[i])
+        {
+            t->primes[t->count++] = (int)i;
+            for (long long j = i * i; j <= limit; j += i)
+                composite[j] = 1;
+        }
+        t->pi[i] = t->count;
+    }
+    free(composite);
+
+    t->phi6 = malloc(sizeof(int) * (PRIME_COUNT_PHI_MOD + 1));
+    t->phi6[0] = 0;
+    for (int r = 1; r <= PRIME_COUNT_PHI_MOD; r++)
+    {
+        int coprime = r % 2 && r % 3 && r % 5 && r % 7 && r % 11 && r % 13;
+        t->phi6[r] = t->phi6[r - 1] + coprime;
+    }
+}
+
+static inline void prime_count_tables_free(PrimeCountTables *t)
+{
+    free(t->pi);
+    free(t->primes);
+    free(t->phi6);
+}
+
+// phi(v, b): integers in [1, v] not divisible by any of primes[0 .. b-1]
+static inline long long prime_count_phi(const PrimeCountTables *t, long long v, int b)
+{
+    if (b < 6)
+        return b == 0 ? v : prime_count_phi(t, v, b - 1) - prime_count_phi(t, v / t->primes[b - 1], b - 1);
+
+    // Once p_(b+1)^2 > v, the survivors are 1 and the primes in (p_b, v]
+    if (v <= t->limit && v < (long long)t->primes[b] * t->primes[b])
+    {
+        long long r = (long long)t->pi[v] - b + 1;
+        return r > 1 ? r : (v >= 1);
+    }
+
+    long long result = (v / PRIME_COUNT_PHI_MOD) * PRIME_COUNT_PHI_TOTIENT + t->phi6[v % PRIME_COUNT_PHI_MOD];
+    for (int i = 6; i < b; i++)
+    {
+        long long w = v / t->primes[i];
+        if (w < t->primes[i])
+        {
+            // Every remaining term is phi(w, i) = 1, one per prime p_i..p_(b-1) that is <= v
+            long long last = v < t->primes[b - 1] ? v : t->primes[b - 1];
+            result -= t->pi[last] - i;
+            break;
+        }
+        result -= prime_count_phi(t, w, i);
+    }
+    return result;
+}
+
+// pi(x), the number of primes <= x. Collective over comm; the result is valid on rank 0.
+static inline long long prime_count_mpi(long long x, MPI_Comm comm)
+{
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    if (x < 2)
+        return 0;
+
+    PrimeCountTables t;
+    long long sqrt_x = prime_count_isqrt(x);
+    prime_count_tables_init(&t, x < PRIME_COUNT_SMALL_X ? x : sqrt_x);
+    if (x <= t.limit)
+    {
+        long long result = t.pi[x];
+        prime_count_tables_free(&t);
+        return result;
+    }
+
+    int a = t.pi[prime_count_icbrt(x)];
+    int b = t.pi[sqrt_x];
+
+    // --- phi(x, a): independent top-level terms, cyclic over ranks ---
+    long long local_phi = 0;
+    if (rank == 0)
+        local_phi = (x / PRIME_COUNT_PHI_MOD) * PRIME_COUNT_PHI_TOTIENT + t.phi6[x % PRIME_COUNT_PHI_MOD];
+    for (int i = 6 + rank; i < a; i += size)
+        local_phi -= prime_count_phi(&t, x / t.primes[i], i);
+
+    // --- P2(x, a): pi(x / p_k) for a < k <= b ---
+    // Values x / p_k <= limit come from the table (rank 0); the rest, in (limit, x / p_(a+1)],
+    // are split into one contiguous block per rank and sieved.
+    long long local_p2 = 0;     // sum of the in-block prime counts pi_block(x / p_k)
+    long long local_terms = 0;  // number of k whose x / p_k falls in this rank's block
+    long long block_primes = 0; // primes in this rank's whole block
+
+    long long range_lo = t.limit + 1;
+    long long range_hi = x / t.primes[a]; // primes[a] is p_(a+1)
+    long long span = range_hi >= range_lo ? range_hi - range_lo + 1 : 0;
+    long long block_lo = range_lo + span * rank / size;
+    long long block_hi = range_lo + span * (rank + 1) / size - 1;
+
+    // k runs downwards from b, so x / p_k runs upwards
+    int k = b;
+    if (rank == 0)
+    {
+        for (; k > a && x / t.primes[k - 1] <= t.limit; k--)
+            local_p2 += t.pi[x / t.primes[k - 1]];
+    }
+    while (k > a && x / t.primes[k - 1] < block_lo)
+        k--;
+
+    unsigned char *segment = malloc(PRIME_COUNT_SEGMENT);
+    for (long long seg_lo = block_lo; seg_lo <= block_hi; seg_lo += PRIME_COUNT_SEGMENT)
+    {
+        long long seg_hi = seg_lo + PRIME_COUNT_SEGMENT - 1;
+        if (seg_hi > block_hi)
+            seg_hi = block_hi;
+        memset(segment, 1, seg_hi - seg_lo + 1);
+
+        for (int i = 0; i < t.count; i++)
+        {
+            long long p = t.primes[i];
+            if (p * p > seg_hi)
+                break;
+            long long start = (seg_lo + p - 1) / p * p;
+            if (start < p * p)
+                start = p * p;
+            for (long long j = start; j <= seg_hi; j += p)
+                segment[j - seg_lo] = 0;
+        }
+
+        // Walk the segment once, stopping at each x / p_k to record the running count
+        long long v = seg_lo;
+        for (; k > a && x / t.primes[k - 1] <= seg_hi; k--)
+        {
+            long long target = x / t.primes[k - 1];
+            for (; v <= target; v++)
+                block_primes += segment[v - seg_lo];
+            local_p2 += block_primes;
+            local_terms++;
+        }
+        for (; v <= seg_hi; v++)
+            block_primes += segment[v - seg_lo];
+    }
+    free(segment);
+
+    // Each in-block count is short by pi(block_lo - 1) = pi(limit) + primes in earlier blocks
+    long long earlier = 0;
+    MPI_Exscan(&block_primes, &earlier, 1, MPI_LONG_LONG, MPI_SUM, comm);
+    if (rank == 0)
+        earlier = 0;
+    local_p2 += local_terms * (t.pi[t.limit] + earlier);
+
+    long long local[2] = {local_phi, local_p2};
+    long long total[2] = {0, 0};
+    MPI_Reduce(local, total, 2, MPI_LONG_LONG, MPI_SUM, 0, comm);
+
+    // sum over a < k <= b of (k - 1)
+    long long k_sum = ((long long)b * (b - 1) - (long long)a * (a - 1)) / 2;
+    long long p2 = total[1] - k_sum;
+
+    prime_count_tables_free(&t);
+    return total[0] + a - 1 - p2;
+}
+
+#endif
@@ -0,0 +1,165 @@
+// prime_gaps.h
+// Distributed prime-gap statistics: gap histogram, maximal-gap records and twin/cousin/sexy
+// counts for the primes below n, computed on the fly without keeping or gathering any primes.
+//
+// Each rank owns a contiguous block of mod-30 wheel bytes (see wheel30.h) and sieves it one
+// segment at a time, feeding the primes in order to prime_gaps_add(). The gap that crosses
+// into the next block is counted by the rank holding the prime before it: every rank passes
+// its first prime (or, if its block has none, the one it received) to its left neighbour.
+// Histograms and counts are merged with MPI_SUM; the record lists with a non-commutative
+// user op that keeps the right operand's records only where they beat the left's maximum.
+// Memory per rank is one sieve segment plus the fixed-size tables below.
+//
+// Header-only; include with #include "../common/prime_gaps.h" from an MPI program.
+
+#ifndef PRIME_GAPS_H
+#define PRIME_GAPS_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include "wheel30.h"
+
+#define PRIME_GAPS_BINS 256        // hist[g / 2] counts gap g (bin 0 is 2 -> 3); the last bin also takes larger gaps
+#define PRIME_GAPS_MAX_RECORDS 160 // records strictly increase over even gaps, so this covers gaps up to 318
+#define PRIME_GAPS_TAG 17
+
+typedef struct
+{
+    int count;
+    long long gap[PRIME_GAPS_MAX_RECORDS];
+    long long after[PRIME_GAPS_MAX_RECORDS]; // the prime that starts the gap
+} PrimeGapRecords;
+
+typedef struct
+{
+    long long primes;
+    long long first; // first and last prime seen, -1 if none
+    long long last;
+    long long hist[PRIME_GAPS_BINS];
+    PrimeGapRecords records; // each gap larger than every earlier one
+} PrimeGaps;
+
+static inline void prime_gaps_init(PrimeGaps *g)
+{
+    memset(g, 0, sizeof(*g));
+    g->first = g->last = -1;
+}
+
+// Count the gap from the previous prime to p, without counting p itself
+static inline void prime_gaps_close(PrimeGaps *g, long long p)
+{
+    if (g->last < 0)
+        return;
+    long long gap = p - g->last;
+    long long bin = gap / 2 < PRIME_GAPS_BINS ? gap / 2 : PRIME_GAPS_BINS - 1;
+    g->hist[bin]++;
+
+    PrimeGapRecords *r = &g->records;
+    if ((r->count == 0 || gap > r->gap[r->count - 1]) && r->count < PRIME_GAPS_MAX_RECORDS)
+    {
+        r->gap[r->count] = gap;
+        r->after[r->count] = g->last;
+        r->count++;
+    }
+}
+
+// Feed the next prime, in increasing order
+static inline void prime_gaps_add(PrimeGaps *g, long long p)
+{
+    prime_gaps_close(g, p);
+    if (g->first < 0)
+        g->first = p;
+    g->last = p;
+    g->primes++;
+}
+
+// MPI_User_function over PrimeGapRecords: inout = in followed by inout, where in comes from lower ranks
+static void prime_gaps_merge_records(void *in, void *inout, int *len, MPI_Datatype *type)
+{
+    (void)type;
+    PrimeGapRecords *a = in, *b = inout;
+    for (int k = 0; k < *len; k++, a++, b++)
+    {
+        PrimeGapRecords merged = *a;
+        long long best = merged.count > 0 ? merged.gap[merged.count - 1] : 0;
+        for (int i = 0; i < b->count && merged.count < PRIME_GAPS_MAX_RECORDS; i++)
+        {
+            if (b->gap[i] > best)
+            {
+                merged.gap[merged.count] = b->gap[i];
+                merged.after[merged.count] = b->after[i];
+                merged.count++;
+                best = b->gap[i];
+            }
+        }
+        *b = merged;
+    }
+}
+
+// Gap statistics of the primes below n. base_primes must hold every prime up to sqrt(n).
+// Collective over comm; the result (primes, hist, records) is valid on rank 0.
+static inline void prime_gaps_mpi(long long n, const int *base_primes, int base_count, MPI_Comm comm,
+                                  PrimeGaps *result)
+{
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    PrimeGaps local;
+    prime_gaps_init(&local);
+    if (rank == 0)
+    {
+        for (int i = 0; i < wheel30_small_primes(n); i++)
+            prime_gaps_add(&local, WHEEL30_SMALL_PRIMES[i]);
+    }
+
+    long long total_bytes = wheel30_bytes(n);
+    long long byte_lo = total_bytes * rank / size;
+    long long byte_hi = total_bytes * (rank + 1) / size;
+    unsigned char *segment = malloc(WHEEL30_SEGMENT_BYTES);
+
+    for (long long seg = byte_lo; seg < byte_hi; seg += WHEEL30_SEGMENT_BYTES)
+    {
+        long long seg_hi = seg + WHEEL30_SEGMENT_BYTES < byte_hi ? seg + WHEEL30_SEGMENT_BYTES : byte_hi;
+        wheel30_sieve(segment, seg, seg_hi, base_primes, base_count);
+        for (long long b = seg; b < seg_hi; b++)
+        {
+            for (unsigned int byte = segment[b - seg]; byte != 0; byte &= byte - 1)
+            {
+                long long v = 30 * b + WHEEL30_RESIDUES[__builtin_ctz(byte)];
+                if (v < n)
+                    prime_gaps_add(&local, v);
+            }
+        }
+    }
+    free(segment);
+
+    // Boundary gap: the first prime after this block comes from the right neighbour, which
+    // forwards its own right neighbour's value when its block holds no prime
+    long long next_first = -1;
+    if (rank < size - 1)
+        MPI_Recv(&next_first, 1, MPI_LONG_LONG, rank + 1, PRIME_GAPS_TAG, comm, MPI_STATUS_IGNORE);
+    if (rank > 0)
+    {
+        long long send = local.first >= 0 ? local.first : next_first;
+        MPI_Send(&send, 1, MPI_LONG_LONG, rank - 1, PRIME_GAPS_TAG, comm);
+    }
+    if (next_first >= 0)
+        prime_gaps_close(&local, next_first);
+
+    prime_gaps_init(result);
+    MPI_Reduce(&local.primes, &result->primes, 1, MPI_LONG_LONG, MPI_SUM, 0, comm);
+    MPI_Reduce(local.hist, result->hist, PRIME_GAPS_BINS, MPI_LONG_LONG, MPI_SUM, 0, comm);
+
+    MPI_Datatype records_type;
+    MPI_Op records_op;
+    MPI_Type_contiguous((int)sizeof(PrimeGapRecords), MPI_BYTE, &records_type);
+    MPI_Type_commit(&records_type);
+    MPI_Op_create(prime_gaps_merge_records, 0, &records_op); // not commutative: rank order matters
+    MPI_Reduce(&local.records, &result->records, 1, records_type, records_op, 0, comm);
+    MPI_Op_free(&records_op);
+    MPI_Type_free(&records_type);
+}
+
+#endif
@@ -0,0 +1,147 @@
+// prime_kernel.h
+// The one prime kernel every program in w4/ and w8/ uses: single-value, batch and range APIs.
+//
+// Single values: n below 256 is read from a constant bitmap. Larger n is divided by 2, 3
+// and 5, then only by divisors coprime to 30 (stepping with WHEEL30_GAPS), up to an
+// integer square root computed once. PRIME_KERNEL_TRIAL stamps the loop out for one integer
+// width; prime_test_u32 is its 32-bit instance, so 32-bit callers never pay for 64-bit
+// division. prime_test_u64 hands anything above 2^32 to deterministic Miller-Rabin.
+// Batches: prime_batch() / prime_batch_range() from prime_batch.h (AVX2/AVX-512 reciprocals).
+// Ranges: prime_sieve_small() for base primes and prime_sieve_range(), a segmented sieve;
+// prime_nth_upper_bound() gives a range that is sure to hold the first k primes.
+//
+// Header-only; include with #include "../common/prime_kernel.h".
+
+#ifndef PRIME_KERNEL_H
+#define PRIME_KERNEL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "wheel30.h"
+#include "miller_rabin.h"
+#include "prime_batch.h"
+
+#define PRIME_KERNEL_SMALL_LIMIT 256 // bitmap covers [0, 256)
+#define PRIME_KERNEL_SEGMENT 32768   // numbers per prime_sieve_range segment (one byte each, fits in L1)
+
+// Bit k is set when k is prime, for k < 256
+static const uint64_t PRIME_KERNEL_SMALL_BITS[4] = {
+    0x28208a20a08a28acULL, 0x800228a202088288ULL, 0x8028208820a00a08ULL, 0x08028228800800a2ULL};
+
+// Trial division by the mod-30 wheel for one integer type
+#define PRIME_KERNEL_TRIAL(name, type)                                          \
+    static inline int name(type n)                                              \
+    {                                                                           \
+        if (n < PRIME_KERNEL_SMALL_LIMIT)                                       \
+            return (int)((PRIME_KERNEL_SMALL_BITS[n >> 6] >> (n & 63)) & 1);    \
+        if (n % 2 == 0 || n % 3 == 0 || n % 5 == 0)                             \
+            return 0;                                                           \
+        type root = (type)sqrt((double)n);                                      \
+        while (root > n / root)                                                 \
+            root--;                                                             \
+        while (root + 1 <= n / (root + 1))                                      \
+            root++;                                                             \
+        type d = 7;                                                             \
+        for (int j = 1; d <= root; d += WHEEL30_GAPS[j], j = (j + 1) & 7)       \
+        {                                                                       \
+            if (n % d == 0)                                                     \
+                return 0;                                                       \
+        }                                                                       \
+        return 1;                                                               \
+    }
+
+PRIME_KERNEL_TRIAL(prime_test_u32, uint32_t)
+
+static inline int prime_test_u64(uint64_t n)
+{
+    if (n <= UINT32_MAX)
+        return prime_test_u32((uint32_t)n);
+    return is_prime_u64(n);
+}
+
+// Trial division of n by an ascending list of primes that covers sqrt(n)
+static inline int prime_test_by(uint32_t n, const int *primes, int count)
+{
+    if (n < 2)
+        return 0;
+    uint32_t root = (uint32_t)sqrt((double)n);
+    for (int i = 0; i < count && (uint32_t)primes[i] <= root; i++)
+    {
+        if (n % primes[i] == 0)
+            return n == (uint32_t)primes[i];
+    }
+    return 1;
+}
+
+// Every prime <= limit, in a new heap array; *count receives its length
+static inline int *prime_sieve_small(int limit, int *count)
+{
+    int *primes = malloc(sizeof(int) * (limit > 1 ? limit / 2 + 2 : 1));
+    char *composite = calloc(limit > 1 ? limit + 1 : 2, 1);
+    *count = 0;
+    for (int i = 2; i <= limit; i++)
+    {
+        if (composite[i])
+            continue;
+        primes[(*count)++] = i;
+        for (long long j = (long long)i * i; j <= limit; j += i)
+            composite[j] = 1;
+    }
+    free(composite);
+    return primes;
+}
+
+// Upper bound on the k-th prime (the 1st is 2): Dusart's k (ln k + ln ln k - 0.9484) for
+// k >= 39017, Rosser's k (ln k + ln ln k) for k >= 6, exact below that
+static inline long long prime_nth_upper_bound(long long k)
+{
+    static const int first[6] = {2, 3, 5, 7, 11, 13};
+    if (k < 1)
+        return 1;
+    if (k <= 6)
+        return first[k - 1];
+    double ln_k = log((double)k);
+    double bound = k * (ln_k + log(ln_k) - (k >= 39017 ? 0.9484 : 0.0));
+    return (long long)bound + 1;
+}
+
+// Segmented Sieve of Eratosthenes over [lo, hi] with base primes covering sqrt(hi).
+// Works one cache-sized segment at a time; returns the number of primes written to out.
+static inline int prime_sieve_range(int lo, int hi, const int *base_primes, int base_count, int *out)
+{
+    unsigned char *segment = malloc(PRIME_KERNEL_SEGMENT);
+    int count = 0;
+
+    for (long long seg_lo = lo; seg_lo <= hi; seg_lo += PRIME_KERNEL_SEGMENT)
+    {
+        long long seg_hi = seg_lo + PRIME_KERNEL_SEGMENT - 1;
+        if (seg_hi > hi)
+            seg_hi = hi;
+        memset(segment, 1, seg_hi - seg_lo + 1);
+
+        for (int i = 0; i < base_count; i++)
+        {
+            long long p = base_primes[i];
+            if (p * p > seg_hi)
+                break;
+            long long start = (seg_lo + p - 1) / p * p;
+            if (start < p * p)
+                start = p * p;
+            for (long long j = start; j <= seg_hi; j += p)
+                segment[j - seg_lo] = 0;
+        }
+
+        for (long long k = seg_lo; k <= seg_hi; k++)
+        {
+            if (k >= 2 && segment[k - seg_lo])
+                out[count++] = (int)k;
+        }
+    }
+
+    free(segment);
+    return count;
+}
+
+#endif
@@ -0,0 +1,123 @@
+// resident_sieve.h
+// A mod-30 wheel sieve kept in memory for point and range queries, grown on demand.
+//
+// bits covers [0, bound) in the wheel30.h layout, with every bit at or above bound clear.
+// Next to it, a Wheel30Index holds cumulative counts per block, so counting the primes below
+// x is one table lookup plus a popcount over at most one block. resident_sieve_grow()
+// extends the bound in place: it re-sieves from the last (partly cut) byte onwards, split
+// over a few threads, and refreshes the index from there.
+// Nothing here locks; a program sharing one sieve between threads must keep readers out
+// while it grows (task2's --serve uses a read/write lock).
+//
+// Header-only; include with #include "../common/resident_sieve.h".
+
+#ifndef RESIDENT_SIEVE_H
+#define RESIDENT_SIEVE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "prime_kernel.h"
+
+typedef struct
+{
+    unsigned char *bits;
+    long long bound; // primes below this are resident
+    long long nbytes;
+    Wheel30Index index; // cumulative counts per block, for count_below
+    int extensions;     // grows after the first
+} ResidentSieve;
+
+typedef struct
+{
+    unsigned char *bits;
+    long long byte_lo, byte_hi;
+    const int *base_primes;
+    int base_count;
+} ResidentSieveSlice;
+
+static inline void *resident_sieve_slice(void *arg)
+{
+    ResidentSieveSlice *s = (ResidentSieveSlice *)arg;
+    if (s->byte_hi > s->byte_lo)
+        wheel30_sieve(s->bits + s->byte_lo, s->byte_lo, s->byte_hi, s->base_primes, s->base_count);
+    return NULL;
+}
+
+static inline void resident_sieve_init(ResidentSieve *rs)
+{
+    memset(rs, 0, sizeof(*rs));
+    rs->extensions = -1;
+}
+
+static inline void resident_sieve_free(ResidentSieve *rs)
+{
+    free(rs->bits);
+    wheel30_index_free(&rs->index);
+    resident_sieve_init(rs);
+}
+
+// Raise the bound to new_bound (no-op if it is not higher), sieving with num_threads threads
+static inline void resident_sieve_grow(ResidentSieve *rs, long long new_bound, int num_threads)
+{
+    if (new_bound <= rs->bound)
+        return;
+    long long new_nbytes = wheel30_bytes(new_bound);
+    long long from = rs->nbytes > 0 ? rs->nbytes - 1 : 0; // the old last byte was cut at the old bound
+    rs->bits = realloc(rs->bits, new_nbytes + 1);
+
+    int base_count;
+    int *base_primes = prime_sieve_small((int)sqrt(30.0 * new_nbytes) + 1, &base_count);
+    if (num_threads < 1)
+        num_threads = 1;
+    pthread_t thread[num_threads];
+    ResidentSieveSlice slice[num_threads];
+    for (int i = 0; i < num_threads; i++)
+    {
+        // Slices of whole sieve segments, so no two threads share a byte
+        long long span = (new_nbytes - from + WHEEL30_SEGMENT_BYTES - 1) / WHEEL30_SEGMENT_BYTES;
+        slice[i].bits = rs->bits;
+        slice[i].byte_lo = from + span * i / num_threads * WHEEL30_SEGMENT_BYTES;
+        slice[i].byte_hi = from + span * (i + 1) / num_threads * WHEEL30_SEGMENT_BYTES;
+        if (slice[i].byte_hi > new_nbytes)
+            slice[i].byte_hi = new_nbytes;
+        if (slice[i].byte_lo > new_nbytes)
+            slice[i].byte_lo = new_nbytes;
+        slice[i].base_primes = base_primes;
+        slice[i].base_count = base_count;
+        pthread_create(&thread[i], NULL, resident_sieve_slice, &slice[i]);
+    }
+    for (int i = 0; i < num_threads; i++)
+        pthread_join(thread[i], NULL);
+    free(base_primes);
+    wheel30_truncate(rs->bits, new_nbytes, new_bound);
+    wheel30_index_update(&rs->index, rs->bits, new_nbytes, from);
+
+    rs->bound = new_bound;
+    rs->nbytes = new_nbytes;
+    rs->extensions++;
+}
+
+// x < rs->bound
+static inline int resident_sieve_is_prime(const ResidentSieve *rs, long long x)
+{
+    if (x < 7)
+        return x == 2 || x == 3 || x == 5;
+    return wheel30_test(rs->bits, x);
+}
+
+// Number of primes below x, for x <= rs->bound
+static inline long long resident_sieve_count_below(const ResidentSieve *rs, long long x)
+{
+    return wheel30_small_primes(x) + wheel30_index_rank(&rs->index, rs->bits, x);
+}
+
+// Smallest prime >= x below rs->bound, or -1 if there is none
+static inline long long resident_sieve_next(const ResidentSieve *rs, long long x)
+{
+    long long p = x <= 2 ? 2 : x <= 3 ? 3 : x <= 5 ? 5 : wheel30_next(rs->bits, rs->nbytes, x);
+    return p >= 0 && p < rs->bound ? p : -1;
+}
+
+#endif
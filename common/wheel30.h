@@ -0,0 +1,282 @@
+// wheel30.h
+// Bit-packed mod-30 wheel storage for prime sieves and prime results.
+//
+// Every integer coprime to 30 has one of eight residues {1,7,11,13,17,19,23,29},
+// so one byte holds the candidates in [30*i, 30*i + 30): bit j of byte i stands
+// for 30*i + WHEEL30_RESIDUES[j]. The primes 2, 3 and 5 have no bit; callers take them
+// from WHEEL30_SMALL_PRIMES / wheel30_print_small(). That is 8 bits per 30 integers
+// instead of one int per prime.
+//
+// Header-only; include with #include "../common/wheel30.h".
+
+#ifndef WHEEL30_H
+#define WHEEL30_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const int WHEEL30_RESIDUES[8] = {1, 7, 11, 13, 17, 19, 23, 29};
+
+// Distance from each residue to the next one (29 -> 31 wraps into the next byte)
+static const int WHEEL30_GAPS[8] = {6, 4, 2, 4, 2, 4, 6, 2};
+
+// Bit index of r = k % 30, or -1 if r shares a factor with 30
+static const signed char WHEEL30_BIT[30] = {
+    -1, 0, -1, -1, -1, -1, -1, 1, -1, -1,
+    -1, 2, -1, 3, -1, -1, -1, 4, -1, 5,
+    -1, -1, -1, 6, -1, -1, -1, -1, -1, 7};
+
+// Index of the first residue >= r (8 means "bit 0 of the next byte")
+static const signed char WHEEL30_NEXT[30] = {
+    0, 0, 1, 1, 1, 1, 1, 1, 2, 2,
+    2, 2, 3, 3, 4, 4, 4, 4, 5, 5,
+    6, 6, 6, 6, 7, 7, 7, 7, 7, 7};
+
+// The primes that have no bit, ascending
+static const int WHEEL30_SMALL_PRIMES[3] = {2, 3, 5};
+
+// How many of WHEEL30_SMALL_PRIMES are below n
+static inline int wheel30_small_primes(long long n)
+{
+    return (n > 2) + (n > 3) + (n > 5);
+}
+
+// Print the primes below n that have no bit, each followed by sep
+static inline void wheel30_print_small(FILE *out, long long n, char sep)
+{
+    for (int i = 0; i < wheel30_small_primes(n); i++)
+        fprintf(out, "%d%c", WHEEL30_SMALL_PRIMES[i], sep);
+}
+
+// Bytes needed to cover [0, n)
+static inline long long wheel30_bytes(long long n)
+{
+    return (n + 29) / 30;
+}
+
+// Mask of the bits in one byte whose value is below 30*byte + r (0 <= r <= 30)
+static inline unsigned char wheel30_mask_below(int r)
+{
+    return r >= 30 ? 0xFF : (unsigned char)((1u << WHEEL30_NEXT[r]) - 1);
+}
+
+static inline int wheel30_test(const unsigned char *bits, long long k)
+{
+    int b = WHEEL30_BIT[k % 30];
+    return b >= 0 && ((bits[k / 30] >> b) & 1);
+}
+
+static inline void wheel30_set(unsigned char *bits, long long k)
+{
+    int b = WHEEL30_BIT[k % 30];
+    if (b >= 0)
+        bits[k / 30] |= (unsigned char)(1u << b);
+}
+
+static inline void wheel30_clear(unsigned char *bits, long long k)
+{
+    int b = WHEEL30_BIT[k % 30];
+    if (b >= 0)
+        bits[k / 30] &= (unsigned char)~(1u << b);
+}
+
+// Drop every bit whose value is >= n, for a bitset of nbytes bytes starting at 0
+static inline void wheel30_truncate(unsigned char *bits, long long nbytes, long long n)
+{
+    long long last = n / 30;
+    if (last >= nbytes)
+        return;
+    bits[last] &= wheel30_mask_below((int)(n % 30));
+    if (last + 1 < nbytes)
+        memset(bits + last + 1, 0, nbytes - last - 1);
+}
+
+// Bytes per sieve segment (about a million integers, fits in L1/L2)
+#define WHEEL30_SEGMENT_BYTES 32768
+
+// Clear the composites in one segment: bits[0 .. byte_hi - byte_lo) covers [30*byte_lo, 30*byte_hi)
+static inline void wheel30_sieve_segment(unsigned char *bits, long long byte_lo, long long byte_hi,
+                                         const int *base_primes, int base_count)
+{
+    long long lo = 30 * byte_lo;
+    long long hi = 30 * byte_hi; // exclusive
+
+    for (int i = 0; i < base_count; i++)
+    {
+        long long p = base_primes[i];
+        if (p < 7)
+            continue;
+        if (p * p >= hi)
+            break;
+
+        // Walk the cofactors q >= max(p, lo/p) that are coprime to 30
+        long long q = (lo + p - 1) / p;
+        if (q < p)
+            q = p;
+        long long qb = q / 30;
+        int qi = WHEEL30_NEXT[q % 30];
+        if (qi == 8)
+        {
+            qb++;
+            qi = 0;
+        }
+        q = 30 * qb + WHEEL30_RESIDUES[qi];
+
+        for (long long m = p * q; m < hi; m = p * q)
+        {
+            bits[m / 30 - byte_lo] &= (unsigned char)~(1u << WHEEL30_BIT[m % 30]);
+            q += WHEEL30_GAPS[qi];
+            qi = (qi + 1) & 7;
+        }
+    }
+}
+
+// Sieve bytes [byte_lo, byte_hi) of the global wheel into bits[0 .. byte_hi - byte_lo).
+// base_primes must hold every prime up to sqrt(30 * byte_hi); 2, 3 and 5 are skipped.
+// Afterwards a bit is set exactly when its value is prime (1 is cleared).
+static inline void wheel30_sieve(unsigned char *bits, long long byte_lo, long long byte_hi,
+                                 const int *base_primes, int base_count)
+{
+    memset(bits, 0xFF, byte_hi - byte_lo);
+    if (byte_lo == 0 && byte_hi > 0)
+        bits[0] &= 0xFE; // 1 is not prime
+
+    for (long long seg = byte_lo; seg < byte_hi; seg += WHEEL30_SEGMENT_BYTES)
+    {
+        long long seg_hi = seg + WHEEL30_SEGMENT_BYTES;
+        if (seg_hi > byte_hi)
+            seg_hi = byte_hi;
+        wheel30_sieve_segment(bits + (seg - byte_lo), seg, seg_hi, base_primes, base_count);
+    }
+}
+
+// Number of set bits in the whole bitset
+static inline long long wheel30_count(const unsigned char *bits, long long nbytes)
+{
+    long long count = 0;
+    for (long long i = 0; i < nbytes; i++)
+        count += __builtin_popcount(bits[i]);
+    return count;
+}
+
+// Rank: number of set values strictly below k. A linear scan over the bytes below k;
+// for repeated queries on one bitset build a Wheel30Index.
+static inline long long wheel30_rank(const unsigned char *bits, long long nbytes, long long k)
+{
+    long long last = k / 30;
+    if (last >= nbytes)
+        return wheel30_count(bits, nbytes);
+    return wheel30_count(bits, last) + __builtin_popcount(bits[last] & wheel30_mask_below((int)(k % 30)));
+}
+
+// Select: value of the j-th (0-based) set bit, or -1 if there are not that many.
+// Also a linear scan; see Wheel30Index.
+static inline long long wheel30_select(const unsigned char *bits, long long nbytes, long long j)
+{
+    for (long long i = 0; i < nbytes; i++)
+    {
+        int c = __builtin_popcount(bits[i]);
+        if (j < c)
+        {
+            unsigned int byte = bits[i];
+            while (j-- > 0)
+                byte &= byte - 1;
+            return 30 * i + WHEEL30_RESIDUES[__builtin_ctz(byte)];
+        }
+        j -= c;
+    }
+    return -1;
+}
+
+// Iteration: smallest set value >= k, or -1 past the end
+static inline long long wheel30_next(const unsigned char *bits, long long nbytes, long long k)
+{
+    long long i = k / 30;
+    if (i >= nbytes)
+        return -1;
+    unsigned int byte = bits[i] & (unsigned char)~wheel30_mask_below((int)(k % 30));
+    while (byte == 0)
+    {
+        if (++i >= nbytes)
+            return -1;
+        byte = bits[i];
+    }
+    return 30 * i + WHEEL30_RESIDUES[__builtin_ctz(byte)];
+}
+
+// Rank/select index: prefix[k] is the number of set bits in bytes [0, k * WHEEL30_INDEX_BLOCK),
+// so a rank is one lookup plus a popcount over at most one block, and a select is a binary
+// search over the blocks plus a scan of one. It costs 8 bytes per block (under 1% extra).
+#define WHEEL30_INDEX_BLOCK 1024 // bytes per index entry (30,720 numbers)
+
+typedef struct
+{
+    long long *prefix; // nbytes / WHEEL30_INDEX_BLOCK + 2 entries
+    long long nbytes;
+} Wheel30Index;
+
+// Build the index of bits[0 .. nbytes), or bring it up to date after a bitset grew or
+// changed from byte `from` on (from = 0 rebuilds it). A new index must start zeroed.
+static inline void wheel30_index_update(Wheel30Index *idx, const unsigned char *bits, long long nbytes,
+                                        long long from)
+{
+    long long blocks = nbytes / WHEEL30_INDEX_BLOCK + 2;
+    idx->prefix = realloc(idx->prefix, sizeof(long long) * blocks);
+    idx->nbytes = nbytes;
+    long long k = from / WHEEL30_INDEX_BLOCK;
+    if (k == 0)
+        idx->prefix[0] = 0;
+    for (; k + 1 < blocks; k++)
+    {
+        long long lo = k * WHEEL30_INDEX_BLOCK;
+        long long len = nbytes - lo < WHEEL30_INDEX_BLOCK ? nbytes - lo : WHEEL30_INDEX_BLOCK;
+        idx->prefix[k + 1] = idx->prefix[k] + (len > 0 ? wheel30_count(bits + lo, len) : 0);
+    }
+}
+
+static inline void wheel30_index_free(Wheel30Index *idx)
+{
+    free(idx->prefix);
+    idx->prefix = NULL;
+    idx->nbytes = 0;
+}
+
+// wheel30_rank() through the index
+static inline long long wheel30_index_rank(const Wheel30Index *idx, const unsigned char *bits, long long k)
+{
+    long long byte = k / 30 < idx->nbytes ? k / 30 : idx->nbytes;
+    long long b = byte / WHEEL30_INDEX_BLOCK;
+    long long count = idx->prefix[b] + wheel30_count(bits + b * WHEEL30_INDEX_BLOCK, byte - b * WHEEL30_INDEX_BLOCK);
+    if (byte < idx->nbytes)
+        count += __builtin_popcount(bits[byte] & wheel30_mask_below((int)(k % 30)));
+    return count;
+}
+
+// wheel30_select() through the index
+static inline long long wheel30_index_select(const Wheel30Index *idx, const unsigned char *bits, long long j)
+{
+    long long blocks = idx->nbytes / WHEEL30_INDEX_BLOCK + 1; // prefix[blocks] is the total
+    if (j < 0 || j >= idx->prefix[blocks])
+        return -1;
+    long long lo = 0, hi = blocks; // last block whose prefix is <= j
+    while (hi - lo > 1)
+    {
+        long long mid = (lo + hi) / 2;
+        if (idx->prefix[mid] <= j)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    long long first = lo * WHEEL30_INDEX_BLOCK;
+    long long v = wheel30_select(bits + first, idx->nbytes - first, j - idx->prefix[lo]);
+    return v < 0 ? -1 : v + 30 * first;
+}
+
+// Visit every set value in order:
+//     long long v;
+//     WHEEL30_FOR_EACH(bits, nbytes, v) { printf("%lld\n", v); }
+#define WHEEL30_FOR_EACH(bits, nbytes, v) \
+    for ((v) = wheel30_next((bits), (nbytes), 0); (v) >= 0; (v) = wheel30_next((bits), (nbytes), (v) + 1))
+
+#endif
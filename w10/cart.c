@@ -3,22 +3,11 @@
 #include <string.h>
 #include <stdlib.h>
 #include <mpi.h>
+#include "../common/mpi_trace.h"
 #define SHIFT_ROW 0
 #define SHIFT_COL 1
 #define DISP 1
 
-int is_prime(int n)
-{
-    if (n <= 1)
-        return 0;
-    for (int i = 2; i * i <= n; i++)
-    {
-        if (n % i == 0)
-            return 0;
-    }
-    return 1;
-}
-
 int random_prime()
 {
     int primes[] = {2,3,5,7,11,13,17,19,23,29,31};
@@ -51,6 +40,7 @@ int main(int argc, char *argv[])
     MPI_Init(&argc, &argv);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
     MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+    mpi_trace_init(MPI_COMM_WORLD);
     /* process command line arguments*/
     if (argc == 3)
     {
@@ -109,59 +99,87 @@ int main(int argc, char *argv[])
     // loop for 500 iterations
     for (int iter = 0; iter < 500; iter++)
     {
-        int my_prime = random_prime();
+        int my_prime = 0;
+        MPI_TRACE_SCOPE(MPI_TRACE_COMPUTE, "random prime")
+        {
+            my_prime = random_prime();
+        }
 
         int recv_left = -1, recv_right = -1, recv_top = -1, recv_bottom = -1;
 
         // Exchange with LEFT neighbor
         if (nbr_j_lo != MPI_PROC_NULL)
         {
-            MPI_Sendrecv(&my_prime, 1, MPI_INT, nbr_j_lo, 0,
-                         &recv_left, 1, MPI_INT, nbr_j_lo, 0,
-                         comm2D, MPI_STATUS_IGNORE);
+            MPI_TRACE_SCOPE(MPI_TRACE_COMM, "sendrecv")
+            {
+                MPI_Sendrecv(&my_prime, 1, MPI_INT, nbr_j_lo, 0,
+                             &recv_left, 1, MPI_INT, nbr_j_lo, 0,
+                             comm2D, MPI_STATUS_IGNORE);
+            }
 
             if (recv_left == my_prime)
             {
-                log_match(my_prime, my_rank, nbr_j_lo);
+                MPI_TRACE_SCOPE(MPI_TRACE_IO, "log match")
+                {
+                    log_match(my_prime, my_rank, nbr_j_lo);
+                }
             }
         }
 
         // Exchange with RIGHT neighbor
         if (nbr_j_hi != MPI_PROC_NULL)
         {
-            MPI_Sendrecv(&my_prime, 1, MPI_INT, nbr_j_hi, 0,
-                         &recv_right, 1, MPI_INT, nbr_j_hi, 0,
-                         comm2D, MPI_STATUS_IGNORE);
+            MPI_TRACE_SCOPE(MPI_TRACE_COMM, "sendrecv")
+            {
+                MPI_Sendrecv(&my_prime, 1, MPI_INT, nbr_j_hi, 0,
+                             &recv_right, 1, MPI_INT, nbr_j_hi, 0,
+                             comm2D, MPI_STATUS_IGNORE);
+            }
 
             if (recv_right == my_prime)
             {
-                log_match(my_prime, my_rank, nbr_j_hi);
+                MPI_TRACE_SCOPE(MPI_TRACE_IO, "log match")
+                {
+                    log_match(my_prime, my_rank, nbr_j_hi);
+                }
             }
         }
 
         // Exchange with TOP neighbor
         if (nbr_i_lo != MPI_PROC_NULL)
         {
-            MPI_Sendrecv(&my_prime, 1, MPI_INT, nbr_i_lo, 0,
-                         &recv_top, 1, MPI_INT, nbr_i_lo, 0,
-                         comm2D, MPI_STATUS_IGNORE);
+            MPI_TRACE_SCOPE(MPI_TRACE_COMM, "sendrecv")
+            {
+                MPI_Sendrecv(&my_prime, 1, MPI_INT, nbr_i_lo, 0,
+                             &recv_top, 1, MPI_INT, nbr_i_lo, 0,
+                             comm2D, MPI_STATUS_IGNORE);
+            }
 
             if (recv_top == my_prime)
             {
-                log_match(my_prime, my_rank, nbr_i_lo);
+                MPI_TRACE_SCOPE(MPI_TRACE_IO, "log match")
+                {
+                    log_match(my_prime, my_rank, nbr_i_lo);
+                }
             }
         }
 
         // Exchange with BOTTOM neighbor
         if (nbr_i_hi != MPI_PROC_NULL)
         {
-            MPI_Sendrecv(&my_prime, 1, MPI_INT, nbr_i_hi, 0,
-                         &recv_bottom, 1, MPI_INT, nbr_i_hi, 0,
-                         comm2D, MPI_STATUS_IGNORE);
+            MPI_TRACE_SCOPE(MPI_TRACE_COMM, "sendrecv")
+            {
+                MPI_Sendrecv(&my_prime, 1, MPI_INT, nbr_i_hi, 0,
+                             &recv_bottom, 1, MPI_INT, nbr_i_hi, 0,
+                             comm2D, MPI_STATUS_IGNORE);
+            }
 
             if (recv_bottom == my_prime)
             {
-                log_match(my_prime, my_rank, nbr_i_hi);
+                MPI_TRACE_SCOPE(MPI_TRACE_IO, "log match")
+                {
+                    log_match(my_prime, my_rank, nbr_i_hi);
+                }
             }
         }
     }
@@ -169,6 +187,7 @@ int main(int argc, char *argv[])
     printf("Global rank: %d. Cart rank: %d. Coord: (%d, %d).Left : %d.Right : % d.Top : % d.Bottom : % d\n ",
            my_rank, my_cart_rank, coord[0], coord[1], nbr_j_lo, nbr_j_hi, nbr_i_lo, nbr_i_hi);
     fflush(stdout);
+    mpi_trace_report(MPI_COMM_WORLD, stdout);
     MPI_Comm_free(&comm2D);
     MPI_Finalize();
     return 0;
@@ -0,0 +1,125 @@
+// batch_bench.c
+// Cycles per candidate for the trial-division kernels: the old % based is_prime of
+// task2/task3, prime_test_u32 from common/prime_kernel.h, and the scalar, AVX2 and
+// AVX-512 paths of common/prime_batch.h.
+// Compile: gcc -O2 -o batch_bench batch_bench.c -lm
+// Run: ./batch_bench [lo] [count]    (odd candidates lo, lo + 2, ...; default 10^9, 10^6)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <x86intrin.h>
+#include "../common/prime_kernel.h"
+
+typedef void (*BatchKernel)(const PrimeDivisors *, const uint32_t *, int, unsigned char *);
+
+// Simple prime checker, as task2.c / task3.c had before the shared kernel
+int is_prime(int n)
+{
+    if (n < 2)
+        return 0;
+    if (n == 2)
+        return 1;
+    if (n % 2 == 0)
+        return 0;
+
+    int sqrt_n = (int)sqrt(n);
+    for (int i = 3; i <= sqrt_n; i += 2)
+    {
+        if (n % i == 0)
+            return 0;
+    }
+    return 1;
+}
+
+double time_diff(struct timespec start, struct timespec end)
+{
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+void report(const char *name, unsigned long long cycles, double seconds, int count, int primes, int expected)
+{
+    printf("%-12s %10.1f %12.2f %10d   %s\n", name, (double)cycles / count, count / seconds / 1e6,
+           primes, primes == expected ? "OK" : "MISMATCH");
+}
+
+int run_batch(const char *name, BatchKernel kernel, const PrimeDivisors *d, const uint32_t *n, int count,
+              unsigned char *flags, int expected)
+{
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    unsigned long long c0 = __rdtsc();
+    for (int i = 0; i < count; i += PRIME_BATCH_WIDTH)
+    {
+        int lanes = count - i < PRIME_BATCH_WIDTH ? count - i : PRIME_BATCH_WIDTH;
+        kernel(d, n + i, lanes, flags + i);
+    }
+    unsigned long long c1 = __rdtsc();
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    int primes = 0;
+    for (int i = 0; i < count; i++)
+        primes += flags[i];
+    report(name, c1 - c0, time_diff(t0, t1), count, primes, expected);
+    return primes == expected;
+}
+
+int main(int argc, char *argv[])
+{
+    long long lo = argc > 1 ? atoll(argv[1]) : 1000000000LL;
+    int count = argc > 2 ? atoi(argv[2]) : 1000000;
+    if (lo < 0 || count <= 0 || lo + 2LL * count > 2147483647LL)
+    {
+        printf("Usage: %s [lo] [count]   (lo + 2 * count must fit in an int)\n", argv[0]);
+        return 1;
+    }
+
+    uint32_t *n = malloc(sizeof(uint32_t) * count);
+    unsigned char *flags = malloc(count);
+    for (int i = 0; i < count; i++)
+        n[i] = (uint32_t)(lo | 1) + 2 * i;
+
+    PrimeDivisors d;
+    prime_divisors_init(&d, n[count - 1]);
+
+    // Baseline: hardware division
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    unsigned long long c0 = __rdtsc();
+    for (int i = 0; i < count; i++)
+        flags[i] = (unsigned char)is_prime((int)n[i]);
+    unsigned long long c1 = __rdtsc();
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    int expected = 0;
+    for (int i = 0; i < count; i++)
+        expected += flags[i];
+
+    printf("%d odd candidates from %u, %d base primes, widest kernel: %s\n", count, n[0], d.count,
+           prime_batch_isa() == 512 ? "AVX-512" : prime_batch_isa() == 256 ? "AVX2" : "scalar");
+    printf("Kernel       Cycles/cand  Mcand/sec     Primes\n");
+    report("is_prime", c1 - c0, time_diff(t0, t1), count, expected, expected);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    c0 = __rdtsc();
+    for (int i = 0; i < count; i++)
+        flags[i] = (unsigned char)prime_test_u32(n[i]);
+    c1 = __rdtsc();
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    int kernel_primes = 0;
+    for (int i = 0; i < count; i++)
+        kernel_primes += flags[i];
+    report("prime_test", c1 - c0, time_diff(t0, t1), count, kernel_primes, expected);
+
+    int ok = kernel_primes == expected;
+    ok &= run_batch("reciprocal", prime_batch_scalar, &d, n, count, flags, expected);
+    if (prime_batch_isa() >= 256)
+        ok &= run_batch("avx2", prime_batch_avx2, &d, n, count, flags, expected);
+    if (prime_batch_isa() >= 512)
+        ok &= run_batch("avx512", prime_batch_avx512, &d, n, count, flags, expected);
+
+    prime_divisors_free(&d);
+    free(n);
+    free(flags);
+    return ok ? 0 : 1;
+}
@@ -1,12 +1,32 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "../common/prime_kernel.h"
+
+#define FIRST_SEGMENT_BYTES 32768 // wheel bytes per sieved segment (983,040 numbers)
+
+// Function prototypes
+void first_primes_sieve(long long k);
+double time_diff(struct timespec start, struct timespec end);
 
 int main(int argc, char *argv[])
 {
-    if (argc != 2)
+    int use_sieve = 0, bad_args = (argc < 2);
+    for (int i = 2; i < argc; i++)
     {
-        printf("Usage: %s <number of primes>\n", argv[0]);
+        if (strcmp(argv[i], "--sieve") == 0)
+            use_sieve = 1;
+        else
+            bad_args = 1;
+    }
+    if (bad_args)
+    {
+        printf("Usage: %s <number of primes> [--sieve]\n", argv[0]);
         return 1;
     }
 
@@ -17,51 +37,143 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    int remainder;
-    // Main loop
-    for (int prime = 2, counter = 0, divider = 2, composite = 0; counter < input; prime += 2)
+    if (use_sieve)
     {
-        // This offsets the increments, so that it skips every even number after 2, because 2 is the only even prime number
-        if (prime == 4)
+        first_primes_sieve(input);
+        return 0;
+    }
+
+    // Main loop: 2, then odd numbers only, each checked by the shared prime kernel
+    for (int prime = 2, counter = 0; counter < input; prime += (prime == 2) ? 1 : 2)
+    {
+        if (prime_test_u32(prime))
         {
-            prime--;
+            printf("%i ", prime);
+            counter++;
         }
+    }
 
-        // This loop is used to check if the prime variable is actually a prime number
-        do
-        {
-            remainder = prime % divider;
+    printf("\n");
+    return 0;
+}
 
-            if (divider < prime && remainder == 0)
-            {
-                composite = 1;
-            }
+// First k primes by sieving instead of testing: the k-th prime is at most
+// prime_nth_upper_bound(k), so the mod-30 wheel below that bound is sieved one segment per
+// loop iteration. Threads sieve and format segments in whatever order they get them; the
+// ordered block writes each segment's text in segment order, so output starts as soon as
+// segment 0 is done, and cuts the text at exactly k primes. After that the remaining
+// iterations only skip, which costs nothing as the bound overshoots by well under 1%.
+// Compile with -fopenmp for threads (OMP_NUM_THREADS); without it the loop runs serially.
+void first_primes_sieve(long long k)
+{
+    struct timespec start, first, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    long long bound = prime_nth_upper_bound(k);
+    long long total_bytes = wheel30_bytes(bound + 1);
+    long long num_segments = (total_bytes + FIRST_SEGMENT_BYTES - 1) / FIRST_SEGMENT_BYTES;
+    int base_count;
+    int *base_primes = prime_sieve_small((int)sqrt(30.0 * total_bytes) + 1, &base_count);
 
-            if (divider > sqrt(prime) && remainder != 0)
+    long long printed = 0, last_prime = 0, segments_used = 0;
+    for (; printed < 3 && printed < k; printed++)
+        printf("%d ", WHEEL30_SMALL_PRIMES[printed]);
+    last_prime = WHEEL30_SMALL_PRIMES[printed - 1];
+    int done = (printed == k), threads = 1;
+    first = start;
+
+#pragma omp parallel
+    {
+        unsigned char *bits = malloc(FIRST_SEGMENT_BYTES);
+        char *text = malloc(8LL * FIRST_SEGMENT_BYTES * 12); // up to 11 digits and a space per wheel bit
+#ifdef _OPENMP
+#pragma omp single
+        threads = omp_get_num_threads();
+#endif
+
+#pragma omp for ordered schedule(dynamic)
+        for (long long s = 0; s < num_segments; s++)
+        {
+            int skip;
+#pragma omp atomic read
+            skip = done;
+
+            char *p = text;
+            long long count = 0;
+            if (!skip)
             {
-                remainder = 0;
-                divider = prime;
+                long long byte_lo = s * FIRST_SEGMENT_BYTES;
+                long long byte_hi = byte_lo + FIRST_SEGMENT_BYTES < total_bytes ? byte_lo + FIRST_SEGMENT_BYTES : total_bytes;
+                wheel30_sieve(bits, byte_lo, byte_hi, base_primes, base_count);
+                for (long long b = 0; b < byte_hi - byte_lo; b++)
+                {
+                    for (unsigned int byte = bits[b]; byte != 0; byte &= byte - 1)
+                    {
+                        long long v = 30 * (byte_lo + b) + WHEEL30_RESIDUES[__builtin_ctz(byte)];
+                        char digits[20];
+                        int len = 0;
+                        do
+                        {
+                            digits[len++] = '0' + v % 10;
+                            v /= 10;
+                        } while (v > 0);
+                        while (len > 0)
+                            *p++ = digits[--len];
+                        *p++ = ' ';
+                        count++;
+                    }
+                }
             }
 
-            if (remainder != 0)
+#pragma omp ordered
             {
-                divider++;
+                if (count > 0 && printed < k)
+                {
+                    // Cut after the (k - printed)-th prime if this segment has more than that
+                    char *cut = p;
+                    if (count > k - printed)
+                    {
+                        count = k - printed;
+                        cut = text;
+                        for (long long i = 0; i < count; i++)
+                            cut = strchr(cut, ' ') + 1;
+                    }
+                    fwrite(text, 1, cut - text, stdout);
+                    if (segments_used == 0)
+                    {
+                        fflush(stdout);
+                        clock_gettime(CLOCK_MONOTONIC, &first);
+                    }
+                    printed += count;
+                    segments_used = s + 1;
+                    if (printed == k)
+                    {
+                        char *last = cut - 1;
+                        while (last > text && last[-1] != ' ')
+                            last--;
+                        last_prime = strtoll(last, NULL, 10);
+#pragma omp atomic write
+                        done = 1;
+                    }
+                }
             }
-
-        }
-        while ((remainder != 0 || prime != divider) && composite != 1);
-
-        composite = 0;
-
-        if (prime == divider && remainder == 0)
-        {
-            printf("%i ", prime);
-            counter++;
         }
 
-        divider = 2;
+        free(bits);
+        free(text);
     }
-
     printf("\n");
-    return 0;
+    fflush(stdout);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    fprintf(stderr, "First %lld primes: p_k = %lld, bound %lld (%.3f%% over), %lld of %lld segments used, %d thread(s)\n",
+            printed, last_prime, bound, 100.0 * (bound - last_prime) / last_prime, segments_used, num_segments,
+            threads);
+    fprintf(stderr, "First output after %.4f sec, wall time %.4f sec\n", time_diff(start, first), time_diff(start, end));
+    free(base_primes);
+}
+
+double time_diff(struct timespec start, struct timespec end)
+{
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
 }
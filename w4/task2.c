@@ -1,32 +1,218 @@
+#define _GNU_SOURCE // pthread_attr_setaffinity_np, for --affinity
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../common/prime_kernel.h"
+#include "../common/prime_cache.h"
+#include "../common/prime_arena.h"
+#include "../common/affinity.h"
+#include "../common/perf_counters.h"
+#include "../common/resident_sieve.h"
 
+#define CHUNK_SIZE 4096 // numbers per work item
+#define STREAM_SEGMENT_BYTES 8192 // wheel bytes per streamed segment (245,760 numbers)
+#define STREAM_SLOTS_PER_THREAD 2 // ring slots per sieving thread
+#define SERVE_TASK_QUERIES 64 // queries per thread-pool task
+#define SERVE_MAX_BOUND 4294967296LL // the resident sieve stops growing at 2^32 (143 MiB)
+#define SERVE_ANSWER_LEN 160
+#define SERVE_LATENCY_BUCKETS 1024 // log-linear, 16 per power of two of nanoseconds
+
+// Per-thread deque of chunk indices [head, tail).
+// The owner takes chunks from the head; thieves take the upper half from the tail.
 typedef struct
 {
-    int lo;
-    int hi;
-    int step;
+    pthread_mutex_t lock;
+    int head;
+    int tail;
+} ChunkDeque;
+
+typedef struct
+{
+    int id;
+    int num_threads;
+    int n;
+    ChunkDeque *deques; // shared, one per thread
+    const PrimeDivisors *divisors; // --batch: SIMD kernel instead of prime_test_u32
+    struct timespec start;
+    int use_perf; // --perf: hardware counters around the chunk loop
+
+    // Filled in by the thread for the busy/idle report
+    double busy;
+    double finish;
+    int chunks_done;
+    int steals;
+    PerfCounters counters;
+    long long events[PERF_COUNTERS_EVENTS];
 } PrimeArgs;
 
 typedef struct
 {
-    int *primes;
+    unsigned char *bits; // shared mod-30 bitset
+    long long first_segment;
+    long long total_bytes;
+    int step;
+    const int *base_primes; // every prime up to sqrt(n)
+    int base_count;
+} WheelArgs;
+
+typedef struct
+{
+    const PrimeCache *cache;
+    unsigned char *bits; // shared mod-30 bitset
+    long long first_segment;
+    long long total_bytes;
+    int step;
+    PrimeCacheStats stats;
+} CacheArgs;
+
+// One ring slot: the formatted text of one segment on its way to the writer
+typedef struct
+{
+    char *text;
+    long long len;
+    long long segment; // segment held, or -1 when free
+    int ready;         // text is complete
+} StreamSlot;
+
+// Shared by the sieving threads and the writer (main thread); one lock guards the ring
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t changed; // a slot was filled or freed
+    StreamSlot *slots;
+    int num_slots;
+    long long next_segment; // next segment to hand to a sieving thread
+    long long num_segments;
+    long long total_bytes;
+    int n;
+    const int *base_primes;
+    int base_count;
+} StreamState;
+
+// One read's worth of complete query lines from a client, answered as a unit
+typedef struct
+{
+    char **lines;
+    char (*answers)[SERVE_ANSWER_LEN];
+    int count;
+    int pending; // pool tasks still running
+    struct timespec received;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+} ServeBatch;
+
+typedef struct ServeTask
+{
+    struct ServeTask *next;
+    ServeBatch *batch;
+    int first;
     int count;
-} PrimeResult;
+} ServeTask;
+
+// Shared by the pool, the client sessions and the accept loop
+typedef struct
+{
+    ResidentSieve sieve;
+    pthread_rwlock_t sieve_lock; // queries read, a lazy extension writes
+    int num_threads;
+
+    pthread_mutex_t queue_lock;
+    pthread_cond_t queue_changed;
+    ServeTask *head, *tail;
+    int stopping; // no more tasks will come; workers exit once the queue is empty
+
+    pthread_mutex_t stats_lock;
+    long long queries, batches;
+    long long latency[SERVE_LATENCY_BUCKETS]; // receipt to answer, per query
+    struct timespec start;
+    int shutdown;  // a client sent "shutdown"; under queue_lock
+    int listen_fd; // -1 when serving stdin
+
+    pthread_mutex_t clients_lock;
+    struct ServeClient *clients; // connections not yet joined, newest first
+} ServeState;
+
+typedef struct ServeClient
+{
+    struct ServeClient *next;
+    ServeState *st;
+    int fd; // -1 once the session is over and the socket closed; under clients_lock
+    pthread_t thread;
+} ServeClient;
 
 void *find_primes(void *arg);
-int is_prime(int n);
+void *stream_segments(void *arg);
+void stream_primes(int n, int num_threads, const AffinityPlan *plan);
+void serve_primes(int n, int num_threads, const AffinityPlan *plan, const char *socket_path);
+int serve_session(ServeState *st, int in_fd, int out_fd);
+void *serve_client(void *arg);
+void serve_reap_clients(ServeState *st, int all);
+void *serve_worker(void *arg);
+void serve_answer(ServeState *st, char *line, char *out);
+void serve_stats(ServeState *st, char *out, int len);
+void *find_primes_wheel(void *arg);
+void *find_primes_cached(void *arg);
+void print_wheel(const unsigned char *bits, long long total_bytes, int n);
+int take_chunk(ChunkDeque *dq);
+int steal_chunks(PrimeArgs *args);
+void report_counters(const PrimeArgs *args, int num_threads);
+double time_diff(struct timespec start, struct timespec end);
 
 int main(int argc, char *argv[])
 {
     long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
 
-    if (argc != 2)
+    int use_wheel = 0, use_batch = 0, use_cache = 0, use_stream = 0, use_perf = 0, use_serve = 0, bad_args = (argc < 2);
+    const char *affinity = NULL, *socket_path = NULL;
+    for (int i = 2; i < argc; i++)
     {
-        printf("Usage: %s <primes less than n>\n", argv[0]);
+        if (strcmp(argv[i], "--wheel") == 0)
+            use_wheel = 1;
+        else if (strcmp(argv[i], "--batch") == 0)
+            use_batch = 1;
+        else if (strcmp(argv[i], "--cache") == 0)
+            use_cache = 1;
+        else if (strcmp(argv[i], "--stream") == 0)
+            use_stream = 1;
+        else if (strcmp(argv[i], "--perf") == 0)
+            use_perf = 1;
+        else if (strcmp(argv[i], "--serve") == 0)
+            use_serve = 1;
+        else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc)
+        {
+            socket_path = argv[++i];
+            use_serve = 1;
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            num_threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--affinity") == 0 && i + 1 < argc)
+            affinity = argv[++i];
+        else if (strncmp(argv[i], "--affinity=", 11) == 0)
+            affinity = argv[i] + 11;
+        else
+            bad_args = 1;
+    }
+    AffinityPlan plan;
+    if (affinity_plan(&plan, affinity) != 0)
+        bad_args = 1;
+    if (use_perf && use_wheel + use_cache + use_stream > 0)
+        bad_args = 1; // counters cover the chunked trial-division and --batch kernels
+    if (use_serve && use_wheel + use_batch + use_cache + use_stream + use_perf > 0)
+        bad_args = 1;
+    if (bad_args || use_wheel + use_batch + use_cache + use_stream > 1)
+    {
+        printf("Usage: %s <primes less than n> [--wheel | --batch | --cache | --stream] [--threads <t>]\n"
+               "          [--affinity compact | scatter | <cpu list, e.g. 0,2,4-7>] [--perf]\n"
+               "       %s <initial sieve bound> --serve [--socket <path>] [--threads <t>] [--affinity ...]\n",
+               argv[0], argv[0]);
         return 1;
     }
 
@@ -39,41 +225,170 @@ int main(int argc, char *argv[])
 
     pthread_t thread[num_threads];
     PrimeArgs args[num_threads];
+    affinity_describe(&plan, num_threads, stderr);
+
+    if (use_wheel)
+    {
+        // One shared bitset of n/30 bytes, sieved in place: whole segments are dealt out
+        // cyclically, so each thread owns whole bytes and no locking is needed
+        long long total_bytes = wheel30_bytes(n);
+        unsigned char *bits = malloc(total_bytes + 1);
+        int base_count;
+        int *base_primes = prime_sieve_small((int)sqrt(30.0 * total_bytes) + 1, &base_count);
+        WheelArgs wargs[num_threads];
+
+        for (int i = 0; i < num_threads; i++)
+        {
+            wargs[i].bits = bits;
+            wargs[i].first_segment = i;
+            wargs[i].total_bytes = total_bytes;
+            wargs[i].step = num_threads;
+            wargs[i].base_primes = base_primes;
+            wargs[i].base_count = base_count;
+
+            affinity_thread_create(&plan, i, &thread[i], find_primes_wheel, (void *)&wargs[i]);
+        }
+
+        for (int i = 0; i < num_threads; i++)
+            pthread_join(thread[i], NULL);
+
+        // The bitset is already in order, so there is nothing to merge or sort
+        wheel30_truncate(bits, total_bytes, n);
+        print_wheel(bits, total_bytes, n);
+        free(base_primes);
+        free(bits);
+        return 0;
+    }
+
+    if (use_stream)
+    {
+        stream_primes(n, num_threads, &plan);
+        return 0;
+    }
+
+    if (use_serve)
+    {
+        serve_primes(n, num_threads, &plan, socket_path);
+        return 0;
+    }
+
+    if (use_cache)
+    {
+        // Same bitset, but filled from the on-disk segment cache (PRIME_CACHE_DIR);
+        // whole segments are dealt out cyclically and only missing ones are sieved
+        long long total_bytes = wheel30_bytes(n);
+        unsigned char *bits = malloc(total_bytes + 1);
+        PrimeCache cache;
+        prime_cache_open(&cache, NULL, n);
+        CacheArgs cargs[num_threads];
+
+        for (int i = 0; i < num_threads; i++)
+        {
+            cargs[i].cache = &cache;
+            cargs[i].bits = bits;
+            cargs[i].first_segment = i;
+            cargs[i].total_bytes = total_bytes;
+            cargs[i].step = num_threads;
+            memset(&cargs[i].stats, 0, sizeof(cargs[i].stats));
+
+            affinity_thread_create(&plan, i, &thread[i], find_primes_cached, (void *)&cargs[i]);
+        }
+
+        PrimeCacheStats total = {0, 0, 0};
+        for (int i = 0; i < num_threads; i++)
+        {
+            pthread_join(thread[i], NULL);
+            total.loaded += cargs[i].stats.loaded;
+            total.sieved += cargs[i].stats.sieved;
+            total.rejected += cargs[i].stats.rejected;
+        }
+        fprintf(stderr, "Prime cache: %lld segments loaded, %lld sieved (%lld invalid)\n",
+                total.loaded, total.sieved, total.rejected);
+
+        wheel30_truncate(bits, total_bytes, n);
+        print_wheel(bits, total_bytes, n);
+        prime_cache_close(&cache);
+        free(bits);
+        return 0;
+    }
+
+    // Split [2, n) into chunks and deal them out in contiguous runs, one deque per thread
+    int num_chunks = (n - 2 + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    if (num_chunks < 0)
+        num_chunks = 0;
+    ChunkDeque deques[num_threads];
+    PrimeDivisors divisors;
+    if (use_batch)
+        prime_divisors_init(&divisors, n);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
     for (int i = 0; i < num_threads; i++)
     {
-        args[i].lo = 2 + i;
-        args[i].hi = n;
-        args[i].step = num_threads;
+        pthread_mutex_init(&deques[i].lock, NULL);
+        deques[i].head = (int)((long long)num_chunks * i / num_threads);
+        deques[i].tail = (int)((long long)num_chunks * (i + 1) / num_threads);
+    }
 
-        pthread_create(&thread[i], NULL, find_primes, (void *)&args[i]);
+    for (int i = 0; i < num_threads; i++)
+    {
+        args[i].id = i;
+        args[i].num_threads = num_threads;
+        args[i].n = n;
+        args[i].deques = deques;
+        args[i].divisors = use_batch ? &divisors : NULL;
+        args[i].start = start;
+        args[i].use_perf = use_perf;
+
+        // Pinned from the start, so the thread's result arena is first touched on its own node
+        affinity_thread_create(&plan, i, &thread[i], find_primes, (void *)&args[i]);
     }
 
     void *void_res[num_threads];
-    PrimeResult *res[num_threads];
+    PrimeArena *res[num_threads];
 
     for (int i = 0; i < num_threads; i++)
     {
         pthread_join(thread[i], &void_res[i]);
-        res[i] = (PrimeResult *)void_res[i];
+        res[i] = (PrimeArena *)void_res[i];
+    }
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double wall = time_diff(start, end);
+
+    // Per-thread busy/idle report (stderr, so stdout stays just the primes)
+    fprintf(stderr, "Thread   Busy(s)   Idle(s)   Done(s)   Busy%%   Chunks   Steals   Primes\n");
+    for (int i = 0; i < num_threads; i++)
+    {
+        fprintf(stderr, "%6d   %7.4f   %7.4f   %7.4f   %5.1f   %6d   %6d   %6d\n",
+                i, args[i].busy, wall - args[i].busy, args[i].finish,
+                wall > 0 ? 100.0 * args[i].busy / wall : 100.0,
+                args[i].chunks_done, args[i].steals, (int)res[i]->count);
     }
+    fprintf(stderr, "Wall time: %.4f sec\n", wall);
+    if (use_perf)
+        report_counters(args, num_threads);
 
     // First, compute total number of primes
     int total_count = 0;
+    long long arena_bytes = 0;
     for (int i = 0; i < num_threads; i++)
-        total_count += res[i]->count;
+    {
+        total_count += (int)res[i]->count;
+        arena_bytes += prime_arena_bytes(res[i]);
+    }
 
     // Allocate one big array
     int *all_primes = malloc(total_count * sizeof(int));
 
-    // Copy thread results into it
-    int index = 0;
+    // Copy thread results into it, then drop each arena
+    int *next = all_primes;
     for (int i = 0; i < num_threads; i++)
     {
-        for (int j = 0; j < res[i]->count; j++)
-        {
-            all_primes[index++] = res[i]->primes[j];
-        }
+        next = prime_arena_copy(res[i], next);
+        prime_arena_free(res[i]);
+        free(res[i]);
     }
 
     int cmpfunc(const void *a, const void *b)
@@ -88,11 +403,12 @@ int main(int argc, char *argv[])
     printf("\n");
 
     for (int i = 0; i < num_threads; i++)
-    {
-        free(res[i]->primes); // free the array of primes
-        free(res[i]);         // free the PrimeResult struct
-    }
+        pthread_mutex_destroy(&deques[i].lock);
     free(all_primes);
+    fprintf(stderr, "Peak RSS: %.1f MiB (result arenas: %.1f MiB, %d primes)\n", prime_peak_rss_kb() / 1024.0,
+            arena_bytes / 1048576.0, total_count);
+    if (use_batch)
+        prime_divisors_free(&divisors);
 
     return 0;
 }
@@ -100,56 +416,814 @@ int main(int argc, char *argv[])
 void *find_primes(void *arg)
 {
     PrimeArgs *args = (PrimeArgs *)arg;
-    // printf("Thread received: lo = %d, hi = %d\n", args->lo, args->hi);
+    ChunkDeque *own = &args->deques[args->id];
 
-    int lo = args->lo;
-    int hi = args->hi;
-    int step = args->step;
+    PrimeArena *result = malloc(sizeof(PrimeArena));
+    prime_arena_init(result);
 
-    int approx_primes = hi / log(hi) * 2;
-    int *res = malloc(approx_primes * sizeof(int));
+    args->busy = 0;
+    args->chunks_done = 0;
+    args->steals = 0;
+    memset(args->events, 0, sizeof(args->events));
+    if (args->use_perf)
+    {
+        // Opened by the thread itself: the events count this thread only
+        perf_counters_open(&args->counters);
+        perf_counters_start(&args->counters);
+    }
 
-    printf("\n\nSize: %i\n\n", approx_primes);
+    for (;;)
+    {
+        int chunk = take_chunk(own);
+        if (chunk < 0)
+        {
+            if (!steal_chunks(args))
+                break; // every deque is empty
+            continue;
+        }
+
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+
+        int lo = 2 + chunk * CHUNK_SIZE;
+        int hi = (args->n - lo > CHUNK_SIZE) ? lo + CHUNK_SIZE : args->n;
+        if (args->divisors != NULL)
+        {
+            // A chunk never holds more primes than numbers, so reserve that much up front
+            int *out = prime_arena_reserve(result, CHUNK_SIZE);
+            prime_arena_commit(result, prime_batch_range(args->divisors, lo, hi, out));
+        }
+        else
+        {
+            for (int k = lo; k < hi; k++)
+            {
+                if (prime_test_u32(k))
+                {
+                    prime_arena_push(result, k);
+                }
+            }
+        }
 
-    int counter = 0;
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        args->busy += time_diff(t0, t1);
+        args->chunks_done++;
+    }
 
-    // Include 2 if in range
-    if (lo <= 2)
+    if (args->use_perf)
     {
-        res[counter++] = 2;
-        lo = 3;
+        perf_counters_stop(&args->counters, args->events);
+        perf_counters_close(&args->counters);
     }
 
-    if (lo % 2 == 0)
-        lo++;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    args->finish = time_diff(args->start, end);
+    return result;
+}
 
-    for (int n = lo; n < hi; n += step)
+// Per-thread hardware counters (stderr), next to the busy/idle report
+void report_counters(const PrimeArgs *args, int num_threads)
+{
+    char reason[160];
+    if (perf_counters_unavailable(&args[0].counters, reason, sizeof(reason)) != NULL)
     {
-        if (is_prime(n))
-            res[counter++] = n;
+        fprintf(stderr, "Perf counters: unavailable (%s)\n", reason);
+        return;
     }
 
-    PrimeResult *result = malloc(sizeof(PrimeResult));
-    result->primes = res;
-    result->count = counter;
-    return result;
+    long long total[PERF_COUNTERS_EVENTS] = {0};
+    perf_counters_header(stderr, "Thread");
+    for (int i = 0; i < num_threads; i++)
+    {
+        char label[16];
+        snprintf(label, sizeof(label), "%6d", i);
+        perf_counters_row(stderr, label, args[i].events);
+        perf_counters_add(total, args[i].events);
+    }
+    perf_counters_row(stderr, " Total", total);
 }
 
-// Simple prime checker
-int is_prime(int n)
+// Owner side: take the next chunk from the head, or -1 if the deque is empty
+int take_chunk(ChunkDeque *dq)
 {
-    if (n < 2)
-        return 0;
-    if (n == 2)
-        return 1;
-    if (n % 2 == 0)
-        return 0;
+    int chunk = -1;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->head < dq->tail)
+        chunk = dq->head++;
+    pthread_mutex_unlock(&dq->lock);
+    return chunk;
+}
+
+// Thief side: move the upper half of the first non-empty victim's chunks into our own deque.
+// Returns 0 once every deque is empty; no new work is ever created, so we can then stop.
+int steal_chunks(PrimeArgs *args)
+{
+    for (int v = 1; v < args->num_threads; v++)
+    {
+        ChunkDeque *victim = &args->deques[(args->id + v) % args->num_threads];
+
+        pthread_mutex_lock(&victim->lock);
+        int available = victim->tail - victim->head;
+        int lo = victim->tail - (available + 1) / 2;
+        int hi = victim->tail;
+        if (available > 0)
+            victim->tail = lo;
+        pthread_mutex_unlock(&victim->lock);
 
-    int sqrt_n = (int)sqrt(n);
-    for (int i = 3; i <= sqrt_n; i += 2)
+        if (available > 0)
+        {
+            ChunkDeque *own = &args->deques[args->id];
+            pthread_mutex_lock(&own->lock);
+            own->head = lo;
+            own->tail = hi;
+            pthread_mutex_unlock(&own->lock);
+            args->steals++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+double time_diff(struct timespec start, struct timespec end)
+{
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+void *find_primes_wheel(void *arg)
+{
+    WheelArgs *args = (WheelArgs *)arg;
+
+    for (long long k = args->first_segment; k * WHEEL30_SEGMENT_BYTES < args->total_bytes; k += args->step)
+    {
+        long long lo = k * WHEEL30_SEGMENT_BYTES;
+        long long hi = lo + WHEEL30_SEGMENT_BYTES < args->total_bytes ? lo + WHEEL30_SEGMENT_BYTES : args->total_bytes;
+        wheel30_sieve(args->bits + lo, lo, hi, args->base_primes, args->base_count);
+    }
+
+    return NULL;
+}
+
+void *find_primes_cached(void *arg)
+{
+    CacheArgs *args = (CacheArgs *)arg;
+
+    for (long long k = args->first_segment; k * PRIME_CACHE_SEGMENT_BYTES < args->total_bytes; k += args->step)
     {
-        if (n % i == 0)
-            return 0;
+        long long lo = k * PRIME_CACHE_SEGMENT_BYTES;
+        long long hi = lo + PRIME_CACHE_SEGMENT_BYTES < args->total_bytes ? lo + PRIME_CACHE_SEGMENT_BYTES : args->total_bytes;
+        prime_cache_fill(args->cache, args->bits + lo, lo, hi, &args->stats);
     }
-    return 1;
-}
\ No newline at end of file
+
+    return NULL;
+}
+
+// Print every prime below n from a mod-30 bitset covering [0, n)
+void print_wheel(const unsigned char *bits, long long total_bytes, int n)
+{
+    wheel30_print_small(stdout, n, ' ');
+    long long v;
+    WHEEL30_FOR_EACH(bits, total_bytes, v)
+        printf("%lld ", v);
+    printf("\n");
+}
+
+// Streaming output: threads sieve consecutive segments of the mod-30 wheel and format
+// them into a ring of num_threads * STREAM_SLOTS_PER_THREAD text buffers; segment s
+// always goes to slot s % num_slots. The main thread writes the slots out in segment
+// order and frees each one as soon as it is written. Memory stays at one ring, however
+// large n is, and the first primes appear as soon as segment 0 is done.
+void stream_primes(int n, int num_threads, const AffinityPlan *plan)
+{
+    struct timespec start, first, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    StreamState st;
+    pthread_mutex_init(&st.lock, NULL);
+    pthread_cond_init(&st.changed, NULL);
+    st.n = n;
+    st.total_bytes = wheel30_bytes(n);
+    st.num_segments = (st.total_bytes + STREAM_SEGMENT_BYTES - 1) / STREAM_SEGMENT_BYTES;
+    st.next_segment = 0;
+    int *base_primes = prime_sieve_small((int)sqrt(30.0 * st.total_bytes) + 1, &st.base_count);
+    st.base_primes = base_primes;
+
+    // Worst case every wheel bit is a prime of up to 10 digits plus a separator
+    long long slot_capacity = 8LL * STREAM_SEGMENT_BYTES * 11;
+    st.num_slots = num_threads * STREAM_SLOTS_PER_THREAD;
+    st.slots = malloc(st.num_slots * sizeof(StreamSlot));
+    for (int i = 0; i < st.num_slots; i++)
+    {
+        st.slots[i].text = malloc(slot_capacity);
+        st.slots[i].len = 0;
+        st.slots[i].segment = -1;
+        st.slots[i].ready = 0;
+    }
+
+    pthread_t thread[num_threads];
+    for (int i = 0; i < num_threads; i++)
+        affinity_thread_create(plan, i, &thread[i], stream_segments, (void *)&st); // each allocates its own segment
+
+    wheel30_print_small(stdout, n, ' ');
+
+    first = start;
+    for (long long s = 0; s < st.num_segments; s++)
+    {
+        StreamSlot *slot = &st.slots[s % st.num_slots];
+        pthread_mutex_lock(&st.lock);
+        while (slot->segment != s || !slot->ready)
+            pthread_cond_wait(&st.changed, &st.lock);
+        pthread_mutex_unlock(&st.lock);
+
+        fwrite(slot->text, 1, slot->len, stdout);
+        if (s == 0)
+        {
+            fflush(stdout);
+            clock_gettime(CLOCK_MONOTONIC, &first);
+        }
+
+        pthread_mutex_lock(&st.lock);
+        slot->segment = -1;
+        slot->ready = 0;
+        pthread_cond_broadcast(&st.changed);
+        pthread_mutex_unlock(&st.lock);
+    }
+    printf("\n");
+    fflush(stdout);
+
+    for (int i = 0; i < num_threads; i++)
+        pthread_join(thread[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    fprintf(stderr, "Stream: %lld segments through %d slots (%.1f MB of buffers), first output after %.4f sec\n",
+            st.num_segments, st.num_slots, st.num_slots * slot_capacity / 1e6, time_diff(start, first));
+    fprintf(stderr, "Wall time: %.4f sec\n", time_diff(start, end));
+
+    for (int i = 0; i < st.num_slots; i++)
+        free(st.slots[i].text);
+    free(st.slots);
+    free(base_primes);
+    pthread_mutex_destroy(&st.lock);
+    pthread_cond_destroy(&st.changed);
+}
+
+void *stream_segments(void *arg)
+{
+    StreamState *st = (StreamState *)arg;
+    unsigned char *bits = malloc(STREAM_SEGMENT_BYTES);
+
+    for (;;)
+    {
+        pthread_mutex_lock(&st->lock);
+        long long s = st->next_segment++;
+        pthread_mutex_unlock(&st->lock);
+        if (s >= st->num_segments)
+            break;
+
+        long long byte_lo = s * STREAM_SEGMENT_BYTES;
+        long long byte_hi = byte_lo + STREAM_SEGMENT_BYTES < st->total_bytes ? byte_lo + STREAM_SEGMENT_BYTES : st->total_bytes;
+        wheel30_sieve(bits, byte_lo, byte_hi, st->base_primes, st->base_count);
+
+        // The slot's previous segment (s - num_slots) is older than anything the writer is
+        // still waiting for, so it is always freed eventually
+        StreamSlot *slot = &st->slots[s % st->num_slots];
+        pthread_mutex_lock(&st->lock);
+        while (slot->segment != -1)
+            pthread_cond_wait(&st->changed, &st->lock);
+        slot->segment = s;
+        pthread_mutex_unlock(&st->lock);
+
+        char *p = slot->text;
+        for (long long b = 0; b < byte_hi - byte_lo; b++)
+        {
+            for (unsigned int byte = bits[b]; byte != 0; byte &= byte - 1)
+            {
+                long long v = 30 * (byte_lo + b) + WHEEL30_RESIDUES[__builtin_ctz(byte)];
+                if (v >= st->n)
+                    break;
+                char digits[20];
+                int len = 0;
+                do
+                {
+                    digits[len++] = '0' + v % 10;
+                    v /= 10;
+                } while (v > 0);
+                while (len > 0)
+                    *p++ = digits[--len];
+                *p++ = ' ';
+            }
+        }
+
+        pthread_mutex_lock(&st->lock);
+        slot->len = p - slot->text;
+        slot->ready = 1;
+        pthread_cond_broadcast(&st->changed);
+        pthread_mutex_unlock(&st->lock);
+    }
+
+    free(bits);
+    return NULL;
+}
+
+// Query server: the primes below a bound stay resident in a ResidentSieve, and clients send
+// newline-separated queries, any number at a time, over a Unix domain socket (--socket) or
+// stdin. Every complete line from one read() is a batch: it is cut into tasks of
+// SERVE_TASK_QUERIES for the worker pool, and the answers go back in order, one line each.
+//   isprime <x>      1 or 0
+//   next <x>         smallest prime > x
+//   count <a> <b>    number of primes in [a, b]
+//   stats            queries so far, queries/sec and latency percentiles
+//   shutdown         stop the server (after answering)
+// A count past the bound, or a next within twice the bound, grows the sieve lazily, to at
+// least twice its size, under a write lock; queries hold the read lock. isprime past the
+// bound and next further out use Miller-Rabin instead, so one far query cannot make the
+// sieve jump. The sieve stops at SERVE_MAX_BOUND, and count beyond it is refused.
+static volatile sig_atomic_t serve_signalled = 0;
+static int serve_listen_fd = -1;
+
+static void serve_on_signal(int sig)
+{
+    (void)sig;
+    serve_signalled = 1;
+    if (serve_listen_fd >= 0)
+        shutdown(serve_listen_fd, SHUT_RDWR); // wakes the accept loop
+}
+
+static int serve_latency_bucket(long long ns)
+{
+    if (ns < 16)
+        return ns < 0 ? 0 : (int)ns;
+    int e = 63 - __builtin_clzll(ns); // 2^e <= ns < 2^(e+1)
+    int b = 16 * (e - 3) + (int)((ns >> (e - 4)) & 15);
+    return b < SERVE_LATENCY_BUCKETS ? b : SERVE_LATENCY_BUCKETS - 1;
+}
+
+// Upper end of a latency bucket, in nanoseconds
+static double serve_latency_upper(int b)
+{
+    if (b < 16)
+        return b + 1;
+    return (double)(16 + b % 16 + 1) * (double)(1LL << (b / 16 - 1));
+}
+
+// Latency quantile q in microseconds; call with stats_lock held
+static double serve_latency_quantile(const ServeState *st, double q)
+{
+    long long seen = 0, target = (long long)ceil(q * st->queries);
+    for (int b = 0; b < SERVE_LATENCY_BUCKETS; b++)
+    {
+        seen += st->latency[b];
+        if (seen >= target && seen > 0)
+            return serve_latency_upper(b) / 1000.0;
+    }
+    return 0.0;
+}
+
+// Grow the resident sieve until it covers [0, need), up to SERVE_MAX_BOUND
+static void serve_ensure(ServeState *st, long long need)
+{
+    if (need > SERVE_MAX_BOUND)
+        need = SERVE_MAX_BOUND;
+    pthread_rwlock_rdlock(&st->sieve_lock);
+    int covered = st->sieve.bound >= need;
+    pthread_rwlock_unlock(&st->sieve_lock);
+    if (covered)
+        return;
+
+    pthread_rwlock_wrlock(&st->sieve_lock);
+    if (st->sieve.bound < need)
+    {
+        long long grown = 2 * st->sieve.bound > need ? 2 * st->sieve.bound : need;
+        resident_sieve_grow(&st->sieve, grown < SERVE_MAX_BOUND ? grown : SERVE_MAX_BOUND, st->num_threads);
+    }
+    pthread_rwlock_unlock(&st->sieve_lock);
+}
+
+void serve_primes(int n, int num_threads, const AffinityPlan *plan, const char *socket_path)
+{
+    ServeState st;
+    memset(&st, 0, sizeof(st));
+    st.num_threads = num_threads;
+    st.listen_fd = -1;
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP); // extensions are not starved
+    pthread_rwlock_init(&st.sieve_lock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+    pthread_mutex_init(&st.queue_lock, NULL);
+    pthread_cond_init(&st.queue_changed, NULL);
+    pthread_mutex_init(&st.stats_lock, NULL);
+    pthread_mutex_init(&st.clients_lock, NULL);
+
+    struct timespec built;
+    clock_gettime(CLOCK_MONOTONIC, &st.start);
+    resident_sieve_init(&st.sieve);
+    resident_sieve_grow(&st.sieve, n, num_threads);
+    clock_gettime(CLOCK_MONOTONIC, &built);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &sa, NULL); // a client that hangs up only fails its own write
+    sa.sa_handler = serve_on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    pthread_t thread[num_threads];
+    for (int i = 0; i < num_threads; i++)
+        affinity_thread_create(plan, i, &thread[i], serve_worker, (void *)&st);
+
+    fprintf(stderr, "Serving: primes below %d resident (sieved in %.4f sec), %d worker thread(s), %s\n", n,
+            time_diff(st.start, built), num_threads, socket_path != NULL ? socket_path : "stdin");
+    clock_gettime(CLOCK_MONOTONIC, &st.start);
+
+    if (socket_path == NULL)
+        serve_session(&st, STDIN_FILENO, STDOUT_FILENO);
+    else
+    {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", socket_path);
+        st.listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(socket_path);
+        if (st.listen_fd < 0 || bind(st.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+            listen(st.listen_fd, 64) != 0)
+        {
+            perror(socket_path);
+        }
+        else
+        {
+            serve_listen_fd = st.listen_fd;
+            // One thread per client only moves bytes; the pool does the answering
+            for (;;)
+            {
+                pthread_mutex_lock(&st.queue_lock);
+                int stop = st.shutdown || serve_signalled;
+                pthread_mutex_unlock(&st.queue_lock);
+                if (stop)
+                    break;
+                int fd = accept(st.listen_fd, NULL, NULL);
+                if (fd < 0)
+                {
+                    if (errno == EINTR || errno == ECONNABORTED)
+                        continue;
+                    break;
+                }
+                ServeClient *client = malloc(sizeof(ServeClient));
+                client->st = &st;
+                client->fd = fd;
+                pthread_mutex_lock(&st.clients_lock);
+                client->next = st.clients;
+                st.clients = client;
+                pthread_create(&client->thread, NULL, serve_client, client);
+                pthread_mutex_unlock(&st.clients_lock);
+                serve_reap_clients(&st, 0);
+            }
+            serve_listen_fd = -1;
+            unlink(socket_path);
+
+            // Clients still connected are dropped: their reads see EOF and their sessions end
+            // once the batch in flight is answered, so the pool must still be running here
+            pthread_mutex_lock(&st.clients_lock);
+            for (ServeClient *c = st.clients; c != NULL; c = c->next)
+            {
+                if (c->fd >= 0)
+                    shutdown(c->fd, SHUT_RDWR);
+            }
+            pthread_mutex_unlock(&st.clients_lock);
+            serve_reap_clients(&st, 1);
+        }
+        if (st.listen_fd >= 0)
+            close(st.listen_fd);
+    }
+
+    // No session is left; workers finish whatever is queued, then exit
+    pthread_mutex_lock(&st.queue_lock);
+    st.stopping = 1;
+    pthread_cond_broadcast(&st.queue_changed);
+    pthread_mutex_unlock(&st.queue_lock);
+    for (int i = 0; i < num_threads; i++)
+        pthread_join(thread[i], NULL);
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = time_diff(st.start, end);
+    pthread_mutex_lock(&st.stats_lock);
+    fprintf(stderr, "Served %lld queries in %lld batches over %.3f sec: %.0f queries/sec\n", st.queries, st.batches,
+            elapsed, elapsed > 0 ? st.queries / elapsed : 0.0);
+    fprintf(stderr, "Latency (receipt to answer): p50 %.1f us, p99 %.1f us, max %.1f us\n",
+            serve_latency_quantile(&st, 0.50), serve_latency_quantile(&st, 0.99), serve_latency_quantile(&st, 1.0));
+    pthread_mutex_unlock(&st.stats_lock);
+    fprintf(stderr, "Resident sieve: primes below %lld, %d lazy extension(s), %.1f MiB\n", st.sieve.bound,
+            st.sieve.extensions, (st.sieve.nbytes + 8.0 * (st.sieve.nbytes / WHEEL30_INDEX_BLOCK + 2)) / 1048576.0);
+
+    resident_sieve_free(&st.sieve);
+    pthread_rwlock_destroy(&st.sieve_lock);
+    pthread_mutex_destroy(&st.queue_lock);
+    pthread_cond_destroy(&st.queue_changed);
+    pthread_mutex_destroy(&st.stats_lock);
+    pthread_mutex_destroy(&st.clients_lock);
+}
+
+// Join and free the threads of finished sessions, or with all set of every client, waiting for each
+void serve_reap_clients(ServeState *st, int all)
+{
+    pthread_mutex_lock(&st->clients_lock);
+    ServeClient **link = &st->clients, *done = NULL;
+    while (*link != NULL)
+    {
+        ServeClient *c = *link;
+        if (all || c->fd < 0)
+        {
+            *link = c->next;
+            c->next = done;
+            done = c;
+        }
+        else
+            link = &c->next;
+    }
+    pthread_mutex_unlock(&st->clients_lock);
+
+    while (done != NULL)
+    {
+        ServeClient *next = done->next;
+        pthread_join(done->thread, NULL);
+        free(done);
+        done = next;
+    }
+}
+
+void *serve_client(void *arg)
+{
+    ServeClient *client = (ServeClient *)arg;
+    ServeState *st = client->st;
+
+    // The listening socket stays open until every client is joined
+    if (serve_session(st, client->fd, client->fd))
+        shutdown(st->listen_fd, SHUT_RDWR);
+
+    // Close right away, so a client reading until EOF sees it now, not at the next accept
+    pthread_mutex_lock(&st->clients_lock);
+    shutdown(client->fd, SHUT_WR);
+    close(client->fd);
+    client->fd = -1;
+    pthread_mutex_unlock(&st->clients_lock);
+    return NULL;
+}
+
+// Answer batches from in_fd on out_fd until EOF; returns 1 if the client asked to shut down
+int serve_session(ServeState *st, int in_fd, int out_fd)
+{
+    long long capacity = 65536, used = 0;
+    char *buf = malloc(capacity + 1);
+    int asked = 0, broken = 0;
+
+    while (!asked && !broken)
+    {
+        if (used == capacity)
+        {
+            capacity *= 2;
+            buf = realloc(buf, capacity + 1);
+        }
+        ssize_t got = read(in_fd, buf + used, capacity - used);
+        if (got <= 0)
+            break;
+        ServeBatch batch;
+        clock_gettime(CLOCK_MONOTONIC, &batch.received);
+        used += got;
+
+        // Complete lines only; a partial last line waits for the next read
+        long long end = used;
+        while (end > 0 && buf[end - 1] != '\n')
+            end--;
+        if (end == 0)
+            continue;
+
+        batch.count = 0;
+        for (long long i = 0; i < end; i++)
+            batch.count += buf[i] == '\n';
+        batch.lines = malloc(batch.count * sizeof(char *));
+        batch.answers = malloc(batch.count * sizeof(*batch.answers));
+        batch.count = 0;
+        for (char *line = buf; line < buf + end;)
+        {
+            char *nl = memchr(line, '\n', buf + end - line);
+            *nl = '\0';
+            if (nl > line && nl[-1] == '\r')
+                nl[-1] = '\0';
+            if (line[0] != '\0')
+                batch.lines[batch.count++] = line;
+            line = nl + 1;
+        }
+
+        batch.pending = (batch.count + SERVE_TASK_QUERIES - 1) / SERVE_TASK_QUERIES;
+        pthread_mutex_init(&batch.lock, NULL);
+        pthread_cond_init(&batch.done, NULL);
+        if (batch.pending > 0)
+        {
+            pthread_mutex_lock(&st->queue_lock);
+            for (int first = 0; first < batch.count; first += SERVE_TASK_QUERIES)
+            {
+                ServeTask *task = malloc(sizeof(ServeTask));
+                task->next = NULL;
+                task->batch = &batch;
+                task->first = first;
+                task->count = batch.count - first < SERVE_TASK_QUERIES ? batch.count - first : SERVE_TASK_QUERIES;
+                if (st->tail != NULL)
+                    st->tail->next = task;
+                else
+                    st->head = task;
+                st->tail = task;
+            }
+            pthread_cond_broadcast(&st->queue_changed);
+            pthread_mutex_unlock(&st->queue_lock);
+
+            pthread_mutex_lock(&batch.lock);
+            while (batch.pending > 0)
+                pthread_cond_wait(&batch.done, &batch.lock);
+            pthread_mutex_unlock(&batch.lock);
+        }
+        pthread_mutex_destroy(&batch.lock);
+        pthread_cond_destroy(&batch.done);
+
+        // All answers of the batch in one write
+        long long len = 0;
+        for (int i = 0; i < batch.count; i++)
+            len += strlen(batch.answers[i]) + 1;
+        char *text = malloc(len + 1), *p = text;
+        for (int i = 0; i < batch.count; i++)
+        {
+            int k = strlen(batch.answers[i]);
+            memcpy(p, batch.answers[i], k);
+            p += k;
+            *p++ = '\n';
+            if (strcmp(batch.lines[i], "shutdown") == 0)
+                asked = 1;
+        }
+        for (long long off = 0; off < len && !broken;)
+        {
+            ssize_t put = write(out_fd, text + off, len - off);
+            if (put < 0 && errno == EINTR)
+                continue;
+            if (put <= 0)
+                broken = 1; // the client went away
+            else
+                off += put;
+        }
+        free(text);
+        free(batch.lines);
+        free(batch.answers);
+
+        pthread_mutex_lock(&st->stats_lock);
+        st->batches++;
+        pthread_mutex_unlock(&st->stats_lock);
+
+        memmove(buf, buf + end, used - end);
+        used -= end;
+    }
+
+    free(buf);
+    if (asked)
+    {
+        pthread_mutex_lock(&st->queue_lock);
+        st->shutdown = 1;
+        pthread_mutex_unlock(&st->queue_lock);
+    }
+    return asked;
+}
+
+void *serve_worker(void *arg)
+{
+    ServeState *st = (ServeState *)arg;
+    for (;;)
+    {
+        pthread_mutex_lock(&st->queue_lock);
+        while (st->head == NULL && !st->stopping)
+            pthread_cond_wait(&st->queue_changed, &st->queue_lock);
+        ServeTask *task = st->head;
+        if (task != NULL)
+        {
+            st->head = task->next;
+            if (st->head == NULL)
+                st->tail = NULL;
+        }
+        pthread_mutex_unlock(&st->queue_lock);
+        if (task == NULL)
+            break; // stopping and nothing left
+
+        ServeBatch *batch = task->batch;
+        int buckets[SERVE_TASK_QUERIES];
+        for (int i = 0; i < task->count; i++)
+        {
+            serve_answer(st, batch->lines[task->first + i], batch->answers[task->first + i]);
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            buckets[i] = serve_latency_bucket((long long)(time_diff(batch->received, now) * 1e9));
+        }
+
+        pthread_mutex_lock(&st->stats_lock);
+        for (int i = 0; i < task->count; i++)
+            st->latency[buckets[i]]++;
+        st->queries += task->count;
+        pthread_mutex_unlock(&st->stats_lock);
+
+        pthread_mutex_lock(&batch->lock);
+        if (--batch->pending == 0)
+            pthread_cond_signal(&batch->done);
+        pthread_mutex_unlock(&batch->lock);
+        free(task);
+    }
+    return NULL;
+}
+
+// Answer one query line into out (SERVE_ANSWER_LEN bytes, no newline)
+void serve_answer(ServeState *st, char *line, char *out)
+{
+    char cmd[16];
+    unsigned long long a = 0, b = 0;
+    int fields = sscanf(line, "%15s %llu %llu", cmd, &a, &b);
+
+    if (fields == 1 && strcmp(cmd, "stats") == 0)
+        serve_stats(st, out, SERVE_ANSWER_LEN);
+    else if (fields == 1 && strcmp(cmd, "shutdown") == 0)
+        snprintf(out, SERVE_ANSWER_LEN, "ok");
+    else if (fields == 2 && strcmp(cmd, "isprime") == 0)
+    {
+        // Past the bound a single Miller-Rabin test beats growing the sieve
+        int prime = -1;
+        pthread_rwlock_rdlock(&st->sieve_lock);
+        if ((long long)a < st->sieve.bound && a < (unsigned long long)SERVE_MAX_BOUND)
+            prime = resident_sieve_is_prime(&st->sieve, (long long)a);
+        pthread_rwlock_unlock(&st->sieve_lock);
+        if (prime < 0)
+            prime = prime_test_u64(a);
+        snprintf(out, SERVE_ANSWER_LEN, "%d", prime);
+    }
+    else if (fields == 2 && strcmp(cmd, "next") == 0)
+    {
+        if (a >= 18446744073709551557ULL) // the largest prime below 2^64
+        {
+            snprintf(out, SERVE_ANSWER_LEN, "error: no 64-bit prime after %llu", a);
+            return;
+        }
+        long long p = -1;
+        for (;;)
+        {
+            pthread_rwlock_rdlock(&st->sieve_lock);
+            long long bound = st->sieve.bound;
+            if ((long long)a + 1 < bound)
+                p = resident_sieve_next(&st->sieve, (long long)a + 1);
+            pthread_rwlock_unlock(&st->sieve_lock);
+            // Only a query just past the resident primes grows them (by doubling)
+            if (p >= 0 || a + 1 >= 2 * (unsigned long long)bound || bound >= SERVE_MAX_BOUND)
+                break;
+            serve_ensure(st, bound + 1);
+        }
+        if (p < 0)
+        {
+            unsigned long long v = a + 1;
+            while (!prime_test_u64(v))
+                v++;
+            snprintf(out, SERVE_ANSWER_LEN, "%llu", v);
+        }
+        else
+            snprintf(out, SERVE_ANSWER_LEN, "%lld", p);
+    }
+    else if (fields == 3 && strcmp(cmd, "count") == 0)
+    {
+        if (b >= (unsigned long long)SERVE_MAX_BOUND)
+        {
+            snprintf(out, SERVE_ANSWER_LEN, "error: count needs b < %lld", SERVE_MAX_BOUND);
+            return;
+        }
+        long long count = 0;
+        if (a <= b)
+        {
+            serve_ensure(st, (long long)b + 1);
+            pthread_rwlock_rdlock(&st->sieve_lock);
+            count = resident_sieve_count_below(&st->sieve, (long long)b + 1) -
+                    resident_sieve_count_below(&st->sieve, (long long)a);
+            pthread_rwlock_unlock(&st->sieve_lock);
+        }
+        snprintf(out, SERVE_ANSWER_LEN, "%lld", count);
+    }
+    else
+        snprintf(out, SERVE_ANSWER_LEN, "error: expected isprime <x> | next <x> | count <a> <b> | stats | shutdown");
+}
+
+// One line of live statistics
+void serve_stats(ServeState *st, char *out, int len)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = time_diff(st->start, now);
+    pthread_rwlock_rdlock(&st->sieve_lock);
+    long long bound = st->sieve.bound;
+    pthread_rwlock_unlock(&st->sieve_lock);
+
+    pthread_mutex_lock(&st->stats_lock);
+    snprintf(out, len, "queries %lld, %.0f queries/sec, p50 %.1f us, p99 %.1f us, resident below %lld", st->queries,
+             elapsed > 0 ? st->queries / elapsed : 0.0, serve_latency_quantile(st, 0.50),
+             serve_latency_quantile(st, 0.99), bound);
+    pthread_mutex_unlock(&st->stats_lock);
+}
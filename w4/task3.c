@@ -1,17 +1,42 @@
+#define _GNU_SOURCE // sched_setaffinity, for --affinity
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 #include <omp.h>
+#include <string.h>
+#include "../common/prime_kernel.h"
+#include "../common/affinity.h"
+
+#define CHUNK_SIZE 4096 // numbers per dynamically scheduled chunk
 
 // Function prototypes
-int find_primes(int n, int res[]);
-int is_prime(int n);
+int *find_primes(int n, int *count, const PrimeDivisors *divisors);
+long long find_primes_wheel(int n, unsigned char *bits);
 
 int main(int argc, char *argv[])
 {
-    if (argc != 2)
+    int use_wheel = 0, use_batch = 0, bad_args = (argc < 2);
+    const char *affinity = NULL;
+    for (int i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--wheel") == 0)
+            use_wheel = 1;
+        else if (strcmp(argv[i], "--batch") == 0)
+            use_batch = 1;
+        else if (strcmp(argv[i], "--affinity") == 0 && i + 1 < argc)
+            affinity = argv[++i];
+        else if (strncmp(argv[i], "--affinity=", 11) == 0)
+            affinity = argv[i] + 11;
+        else
+            bad_args = 1;
+    }
+    AffinityPlan plan;
+    if (affinity_plan(&plan, affinity) != 0)
+        bad_args = 1;
+    if (bad_args || use_wheel + use_batch > 1)
     {
-        printf("Usage: %s <primes less than n>\n", argv[0]);
+        printf("Usage: %s <primes less than n> [--wheel | --batch] [--affinity compact | scatter | <cpu list>]\n",
+               argv[0]);
         return 1;
     }
 
@@ -22,11 +47,41 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    // Rough estimate for number of primes < n (for array size)
-    int approx_primes = (int)(n / log(n) * 2);
-    int res[approx_primes];
+    // The thread pool persists across parallel regions, so pinning it once, before any
+    // buffer is allocated, keeps every later first touch on the thread's own node
+    if (plan.count > 0)
+    {
+#pragma omp parallel
+        affinity_pin_self(&plan, omp_get_thread_num());
+        affinity_describe(&plan, omp_get_max_threads(), stderr);
+    }
 
-    int count = find_primes(n, res);
+    if (use_wheel)
+    {
+        // Mod-30 bitset on the heap: n/30 bytes, already in order when printed
+        long long total_bytes = wheel30_bytes(n);
+        unsigned char *bits = calloc(total_bytes + 1, 1);
+        find_primes_wheel(n, bits);
+
+        wheel30_print_small(stdout, n, ' ');
+        long long v;
+        WHEEL30_FOR_EACH(bits, total_bytes, v)
+        {
+            printf("%lld ", v);
+        }
+        printf("\n");
+
+        free(bits);
+        return 0;
+    }
+
+    // --batch: SIMD trial division against precomputed reciprocals instead of prime_test_u32
+    PrimeDivisors divisors;
+    if (use_batch)
+        prime_divisors_init(&divisors, n);
+
+    int count;
+    int *res = find_primes(n, &count, use_batch ? &divisors : NULL);
 
     // Print results
     for (int i = 0; i < count; i++)
@@ -35,41 +90,139 @@ int main(int argc, char *argv[])
     }
     printf("\n");
 
+    free(res);
+    if (use_batch)
+        prime_divisors_free(&divisors);
     return 0;
 }
 
-// Fill res[] with all primes < n, return count
-int find_primes(int n, int res[])
+// Collect all primes < n, in order, into a heap array; *count receives its length.
+// 1. Threads take chunks with schedule(dynamic) and append primes to a private buffer,
+//    noting where each chunk starts in that buffer and how many primes it produced.
+// 2. A parallel exclusive prefix sum over the per-chunk counts gives every chunk its
+//    final position in the result.
+// 3. Each thread copies its own chunks into place. Nothing is shared on the hot path.
+// With divisors set, chunks are tested with the batch kernel rather than prime_test_u32.
+int *find_primes(int n, int *count, const PrimeDivisors *divisors)
 {
-    int count = 0;
+    int num_chunks = n > 2 ? (n - 2 + CHUNK_SIZE - 1) / CHUNK_SIZE : 0;
+    int *chunk_count = malloc((num_chunks + 1) * sizeof(int));  // primes found in chunk c
+    int *chunk_local = malloc((num_chunks + 1) * sizeof(int));  // start of chunk c in its thread's buffer
+    int *chunk_offset = malloc((num_chunks + 1) * sizeof(int)); // start of chunk c in the result
+    int *thread_sum = calloc(omp_get_max_threads() + 1, sizeof(int));
+    int *res = NULL;
 
-#pragma omp parallel for
-    for (int i = 2; i < n; i++)
+#pragma omp parallel
     {
-        if (is_prime(i))
+        int tid = omp_get_thread_num();
+        int nt = omp_get_num_threads();
+
+        int capacity = 1024, local_count = 0;
+        int *local = malloc(capacity * sizeof(int));
+        int chunks_capacity = 64, my_chunk_count = 0;
+        int *my_chunks = malloc(chunks_capacity * sizeof(int));
+
+#pragma omp for schedule(dynamic)
+        for (int c = 0; c < num_chunks; c++)
         {
-            res[count++] = i;
+            int lo = 2 + c * CHUNK_SIZE;
+            int hi = (n - lo > CHUNK_SIZE) ? lo + CHUNK_SIZE : n;
+
+            chunk_local[c] = local_count;
+            if (divisors != NULL)
+            {
+                if (capacity - local_count < CHUNK_SIZE)
+                {
+                    capacity = 2 * capacity + CHUNK_SIZE;
+                    local = realloc(local, capacity * sizeof(int));
+                }
+                local_count += prime_batch_range(divisors, lo, hi, local + local_count);
+            }
+            else
+            {
+                for (int k = lo; k < hi; k++)
+                {
+                    if (prime_test_u32(k))
+                    {
+                        if (local_count == capacity)
+                        {
+                            capacity *= 2;
+                            local = realloc(local, capacity * sizeof(int));
+                        }
+                        local[local_count++] = k;
+                    }
+                }
+            }
+            chunk_count[c] = local_count - chunk_local[c];
+
+            if (my_chunk_count == chunks_capacity)
+            {
+                chunks_capacity *= 2;
+                my_chunks = realloc(my_chunks, chunks_capacity * sizeof(int));
+            }
+            my_chunks[my_chunk_count++] = c;
+        }
+
+        // Prefix sum: each thread totals a contiguous block of chunks...
+        int c_lo = (int)((long long)num_chunks * tid / nt);
+        int c_hi = (int)((long long)num_chunks * (tid + 1) / nt);
+        int block_sum = 0;
+        for (int c = c_lo; c < c_hi; c++)
+            block_sum += chunk_count[c];
+        thread_sum[tid + 1] = block_sum;
+
+#pragma omp barrier
+#pragma omp single
+        {
+            // ...the block totals are scanned serially (one entry per thread)...
+            for (int t = 0; t < nt; t++)
+                thread_sum[t + 1] += thread_sum[t];
+            *count = thread_sum[nt];
+            res = malloc((*count + 1) * sizeof(int));
+        }
+
+        // ...and each thread finishes the scan over its own block
+        int offset = thread_sum[tid];
+        for (int c = c_lo; c < c_hi; c++)
+        {
+            chunk_offset[c] = offset;
+            offset += chunk_count[c];
         }
+
+#pragma omp barrier
+        for (int i = 0; i < my_chunk_count; i++)
+        {
+            int c = my_chunks[i];
+            memcpy(res + chunk_offset[c], local + chunk_local[c], chunk_count[c] * sizeof(int));
+        }
+
+        free(local);
+        free(my_chunks);
     }
 
-    return count;
+    free(chunk_count);
+    free(chunk_local);
+    free(chunk_offset);
+    free(thread_sum);
+    return res;
 }
 
-// Simple prime checker
-int is_prime(int n)
+// Sieve all primes < n (other than 2, 3, 5) into a mod-30 bitset, return how many.
+// Each iteration sieves one segment of whole bytes, so threads never write the same memory.
+long long find_primes_wheel(int n, unsigned char *bits)
 {
-    if (n < 2)
-        return 0;
-    if (n == 2)
-        return 1;
-    if (n % 2 == 0)
-        return 0;
+    long long total_bytes = wheel30_bytes(n);
+    int base_count;
+    int *base_primes = prime_sieve_small((int)sqrt(30.0 * total_bytes) + 1, &base_count);
 
-    int sqrt_n = (int)sqrt(n);
-    for (int i = 3; i <= sqrt_n; i += 2)
+#pragma omp parallel for schedule(dynamic)
+    for (long long lo = 0; lo < total_bytes; lo += WHEEL30_SEGMENT_BYTES)
     {
-        if (n % i == 0)
-            return 0;
+        long long hi = lo + WHEEL30_SEGMENT_BYTES < total_bytes ? lo + WHEEL30_SEGMENT_BYTES : total_bytes;
+        wheel30_sieve(bits + lo, lo, hi, base_primes, base_count);
     }
-    return 1;
+
+    free(base_primes);
+    wheel30_truncate(bits, total_bytes, n);
+    return wheel30_count(bits, total_bytes);
 }
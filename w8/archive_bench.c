@@ -0,0 +1,172 @@
+// archive_bench.c
+// Compares the binary prime archive (common/prime_archive.h) with the decimal text
+// format of primes_mpi.txt: file size, encode and decode throughput, random access.
+// Compile: gcc -O2 -o archive_bench archive_bench.c -lm
+// Run: ./archive_bench <n>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "../common/prime_kernel.h"
+#include "../common/prime_archive.h"
+
+#define TEXT_FILE "bench_primes.txt"
+#define ARCHIVE_FILE "bench_primes.pa"
+#define QUERIES 100000
+
+double time_diff(struct timespec start, struct timespec end)
+{
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+long long file_size(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 ? (long long)st.st_size : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        printf("Usage: %s <n>\n", argv[0]);
+        return 1;
+    }
+
+    long long n = atoll(argv[1]);
+    if (n <= 2)
+    {
+        printf("Please enter an integer greater than 2.\n");
+        return 1;
+    }
+
+    // Primes below n from the wheel sieve, as a plain array
+    int base_count = 0;
+    int *base_primes = prime_sieve_small((int)sqrt((double)n) + 1, &base_count);
+
+    long long total_bytes = wheel30_bytes(n);
+    unsigned char *bits = malloc(total_bytes + 1);
+    wheel30_sieve(bits, 0, total_bytes, base_primes, base_count);
+    wheel30_truncate(bits, total_bytes, n);
+
+    long long count = wheel30_count(bits, total_bytes) + wheel30_small_primes(n);
+    uint64_t *primes = malloc(sizeof(uint64_t) * count);
+    long long k = 0, v;
+    for (int i = 0; i < wheel30_small_primes(n); i++)
+        primes[k++] = WHEEL30_SMALL_PRIMES[i];
+    WHEEL30_FOR_EACH(bits, total_bytes, v)
+        primes[k++] = v;
+    free(bits);
+    free(base_primes);
+
+    struct timespec t0, t1;
+    uint64_t checksum = 0, text_checksum = 0, archive_checksum = 0;
+    for (long long i = 0; i < count; i++)
+        checksum += primes[i];
+
+    // --- Encode ---
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    FILE *f = fopen(TEXT_FILE, "w");
+    for (long long i = 0; i < count; i++)
+        fprintf(f, "%llu\n", (unsigned long long)primes[i]);
+    fclose(f);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double text_encode = time_diff(t0, t1);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    PrimeArchiveWriter w;
+    if (prime_archive_create(&w, ARCHIVE_FILE) != 0)
+    {
+        printf("Cannot create %s\n", ARCHIVE_FILE);
+        return 1;
+    }
+    for (long long i = 0; i < count; i++)
+        prime_archive_append(&w, primes[i]);
+    prime_archive_finish(&w, n);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double archive_encode = time_diff(t0, t1);
+
+    // --- Decode everything ---
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    f = fopen(TEXT_FILE, "r");
+    unsigned long long p;
+    long long text_count = 0;
+    while (fscanf(f, "%llu", &p) == 1)
+    {
+        text_checksum += p;
+        text_count++;
+    }
+    fclose(f);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double text_decode = time_diff(t0, t1);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    PrimeArchive ar;
+    if (prime_archive_open(&ar, ARCHIVE_FILE) != 0)
+    {
+        printf("Cannot open %s\n", ARCHIVE_FILE);
+        return 1;
+    }
+    uint64_t *decoded = malloc(sizeof(uint64_t) * (count + 1));
+    long long archive_count = prime_archive_range(&ar, 0, n, decoded, count);
+    for (long long i = 0; i < archive_count; i++)
+        archive_checksum += decoded[i];
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double archive_decode = time_diff(t0, t1);
+    free(decoded);
+
+    // --- Random access: k-th prime and short ranges ---
+    srand(3143);
+    int mismatches = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int q = 0; q < QUERIES; q++)
+    {
+        long long i = ((long long)rand() * RAND_MAX + rand()) % count;
+        if (prime_archive_nth(&ar, i) != primes[i])
+            mismatches++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double nth_time = time_diff(t0, t1);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int q = 0; q < QUERIES; q++)
+    {
+        long long i = ((long long)rand() * RAND_MAX + rand()) % count;
+        long long j = i + rand() % 100;
+        if (j >= count)
+            j = count - 1;
+        if (prime_archive_range(&ar, primes[i], primes[j], NULL, 0) != (uint64_t)(j - i + 1))
+            mismatches++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double range_time = time_diff(t0, t1);
+    prime_archive_close(&ar);
+
+    long long text_size = file_size(TEXT_FILE);
+    long long archive_size = file_size(ARCHIVE_FILE);
+
+    printf("Primes below %lld: %lld\n", n, count);
+    printf("                         text          archive\n");
+    printf("File size (bytes):       %-13lld %-13lld (%.2fx smaller)\n",
+           text_size, archive_size, (double)text_size / archive_size);
+    printf("Bytes per prime:         %-13.2f %-13.2f\n",
+           (double)text_size / count, (double)archive_size / count);
+    printf("Encode (Mprimes/sec):    %-13.2f %-13.2f\n",
+           count / text_encode / 1e6, count / archive_encode / 1e6);
+    printf("Decode (Mprimes/sec):    %-13.2f %-13.2f\n",
+           text_count / text_decode / 1e6, archive_count / archive_decode / 1e6);
+    printf("k-th prime query:        %.3f usec\n", nth_time / QUERIES * 1e6);
+    printf("Range [a,b] query:       %.3f usec\n", range_time / QUERIES * 1e6);
+
+    int ok = text_count == count && archive_count == count &&
+             text_checksum == checksum && archive_checksum == checksum && mismatches == 0;
+    printf("Round trip:              %s\n", ok ? "OK" : "MISMATCH");
+
+    remove(TEXT_FILE);
+    remove(ARCHIVE_FILE);
+    free(primes);
+    return ok ? 0 : 1;
+}
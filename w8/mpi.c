@@ -1,15 +1,84 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <mpi.h>
 #include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "../common/prime_kernel.h"
+#include "../common/prime_cache.h"
+#include "../common/prime_archive.h"
+#include "../common/prime_count.h"
+#include "../common/prime_gaps.h"
+#include "../common/goldbach.h"
+#include "../common/mpi_trace.h"
+#include "../common/prime_arena.h"
+#include "../common/perf_counters.h"
 
-int isPrime(int k) {
-    if (k < 2) return 0;
-    for (int i = 2; i <= sqrt(k); i++) {
-        if (k % i == 0) return 0;
+#define WRITE_PIECE (1LL << 30) // bytes per MPI_File_write_at_all call, within an int count
+
+// Append v and a newline to p (same text as fprintf "%d\n"), return the new end
+char* appendPrime(char* p, long long v) {
+    char digits[20];
+    int len = 0;
+    do {
+        digits[len++] = '0' + v % 10;
+        v /= 10;
+    } while (v > 0);
+    while (len > 0) *p++ = digits[--len];
+    *p++ = '\n';
+    return p;
+}
+
+// Collective output: each rank writes its own, already formatted slice of the file.
+// An exclusive prefix sum of the byte counts gives every rank its offset. MPI counts are
+// ints, so slices go out in rounds of at most WRITE_PIECE bytes; every rank joins every
+// round of the collective, with an empty piece once its slice is done.
+void writeCollective(const char* path, const char* text, long long len, MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    long long offset = 0;
+    MPI_Exscan(&len, &offset, 1, MPI_LONG_LONG, MPI_SUM, comm);
+    if (rank == 0) offset = 0; // MPI_Exscan leaves rank 0 undefined
+    long long max_len = 0;
+    MPI_Allreduce(&len, &max_len, 1, MPI_LONG_LONG, MPI_MAX, comm);
+
+    MPI_File fh;
+    MPI_File_open(comm, path, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
+    MPI_File_set_size(fh, 0); // truncate any previous, longer run
+    for (long long done = 0; done < max_len; done += WRITE_PIECE) {
+        long long piece = len - done < WRITE_PIECE ? len - done : WRITE_PIECE;
+        if (piece < 0) piece = 0;
+        MPI_File_write_at_all(fh, offset + done, piece > 0 ? text + done : text, (int)piece, MPI_CHAR,
+                              MPI_STATUS_IGNORE);
+    }
+    MPI_File_close(&fh);
+}
+
+// Root-side output of a gathered mod-30 bitset covering [0, n): text file or binary archive
+void writeWheel(const unsigned char* bits, long long total_bytes, int n, int use_archive) {
+    long long v;
+    if (use_archive) {
+        PrimeArchiveWriter w;
+        prime_archive_create(&w, "primes_mpi.pa");
+        for (int i = 0; i < wheel30_small_primes(n); i++) {
+            prime_archive_append(&w, WHEEL30_SMALL_PRIMES[i]);
+        }
+        WHEEL30_FOR_EACH(bits, total_bytes, v) {
+            prime_archive_append(&w, v);
+        }
+        prime_archive_finish(&w, n);
+    } else {
+        FILE* f = fopen("primes_mpi.txt", "w");
+        wheel30_print_small(f, n, '\n');
+        WHEEL30_FOR_EACH(bits, total_bytes, v) {
+            fprintf(f, "%lld\n", v);
+        }
+        fclose(f);
     }
-    return 1;
 }
 
 int compare(const void* a, const void* b) {
@@ -22,17 +91,67 @@ double time_diff(struct timespec start, struct timespec end) {
 
 int main(int argc, char* argv[]) {
     int rank, size;
-    struct timespec T_start, T_p1_start, T_p1_end, T_p2_start, T_p2_end, T_sort, T_file;
+    struct timespec T_start, T_p1_start, T_p1_end, T_p2_start, T_p2_end, T_gather, T_sort, T_file;
 
-    MPI_Init(&argc, &argv);
+    int provided; // only the main thread calls MPI, also in --hybrid
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
+    mpi_trace_init(MPI_COMM_WORLD);
 
-    if (argc != 2) {
-        if (rank == 0) fprintf(stderr, "Usage: %s <n>\n", argv[0]);
+    int use_sieve = 0, use_wheel = 0, use_ordered = 0, use_mpiio = 0, use_archive = 0, use_count = 0, use_cache = 0, use_hybrid = 0, use_gaps = 0, use_goldbach = 0, use_perf = 0;
+    int bad_args = (argc < 2);
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--sieve") == 0) use_sieve = 1;
+        else if (strcmp(argv[i], "--wheel") == 0) use_wheel = 1;
+        else if (strcmp(argv[i], "--ordered") == 0) use_ordered = 1;
+        else if (strcmp(argv[i], "--mpiio") == 0) use_mpiio = 1;
+        else if (strcmp(argv[i], "--archive") == 0) use_archive = 1;
+        else if (strcmp(argv[i], "--count") == 0) use_count = 1;
+        else if (strcmp(argv[i], "--cache") == 0) use_cache = use_wheel = 1; // cache segments are wheel bitsets
+        else if (strcmp(argv[i], "--hybrid") == 0) use_hybrid = use_wheel = 1;
+        else if (strcmp(argv[i], "--gaps") == 0) use_gaps = 1;
+        else if (strcmp(argv[i], "--goldbach") == 0) use_goldbach = 1;
+        else if (strcmp(argv[i], "--perf") == 0) use_perf = 1;
+        else bad_args = 1;
+    }
+    if (use_mpiio && use_archive) bad_args = 1;
+    if (use_cache && use_sieve) bad_args = 1;
+    if (use_hybrid && (use_sieve || use_cache || use_mpiio)) bad_args = 1;
+    if ((use_gaps || use_goldbach) && (argc != 3)) bad_args = 1; // statistics only, nothing is gathered or written
+    if (use_perf && use_count) bad_args = 1; // counters cover Phase 2 of the listing modes
+
+    if (bad_args) {
+        if (rank == 0) fprintf(stderr, "Usage: %s <n> [--sieve | --wheel | --cache | --hybrid] [--ordered] [--mpiio | --archive] [--perf] | %s <n> --count | --gaps | --goldbach\n", argv[0], argv[0]);
         MPI_Finalize();
         return 1;
     }
+    if (use_hybrid && provided < MPI_THREAD_FUNNELED) {
+        // Threads next to MPI need at least FUNNELED; without it every rank runs one thread
+        if (rank == 0) fprintf(stderr, "MPI provides thread level %d, below MPI_THREAD_FUNNELED: --hybrid runs one thread per rank\n", provided);
+#ifdef _OPENMP
+        omp_set_num_threads(1);
+#endif
+    }
+
+    if (use_count) {
+        // --- Count only: sublinear pi(n - 1), n may be up to ~10^15 ---
+        long long count_n = atoll(argv[1]);
+        clock_gettime(CLOCK_MONOTONIC, &T_start);
+        long long count = 0;
+        MPI_TRACE_SCOPE(MPI_TRACE_COMPUTE, "prime count") {
+            count = prime_count_mpi(count_n - 1, MPI_COMM_WORLD);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &T_file);
+
+        if (rank == 0) {
+            printf("Primes below %lld:  %lld\n", count_n, count);
+            printf("Count time (Meissel):  %.4f sec\n", time_diff(T_start, T_file));
+        }
+        mpi_trace_report(MPI_COMM_WORLD, stdout);
+        MPI_Finalize();
+        return 0;
+    }
 
     int n = atoi(argv[1]);
     int root_n = (int)sqrt(n);
@@ -44,113 +163,494 @@ int main(int argc, char* argv[]) {
     // --- Phase 1: Serial on root ---
     clock_gettime(CLOCK_MONOTONIC, &T_p1_start);
     if (rank == 0) {
-        base_primes = malloc(sizeof(int) * (root_n + 1));
-        for (int i = 2; i <= root_n; i++) {
-            if (isPrime(i)) {
-                base_primes[base_count++] = i;
-            }
+        MPI_TRACE_SCOPE(MPI_TRACE_COMPUTE, "phase 1: base primes") {
+            base_primes = prime_sieve_small(root_n, &base_count);
         }
     }
     clock_gettime(CLOCK_MONOTONIC, &T_p1_end);
 
-    // --- Broadcast base primes ---
-    MPI_Bcast(&base_count, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    if (rank != 0) base_primes = malloc(sizeof(int) * base_count);
-    MPI_Bcast(base_primes, base_count, MPI_INT, 0, MPI_COMM_WORLD);
+    // --- Broadcast base primes (hybrid mode shares one copy per node instead) ---
+    if (!use_hybrid) {
+        MPI_TRACE_SCOPE(MPI_TRACE_COMM, "bcast base primes") {
+            MPI_Bcast(&base_count, 1, MPI_INT, 0, MPI_COMM_WORLD);
+            if (rank != 0) base_primes = malloc(sizeof(int) * base_count);
+            MPI_Bcast(base_primes, base_count, MPI_INT, 0, MPI_COMM_WORLD);
+        }
+    }
 
-    // --- Phase 2 Range Calculation (safe block+remainder) ---
-    int total_range = n - root_n - 1;
-    int base = total_range / size;
-    int remainder = total_range % size;
+    if (use_gaps) {
+        // --- Gap statistics: every rank sieves its block, only histograms and records are reduced ---
+        PrimeGaps gaps;
+        clock_gettime(CLOCK_MONOTONIC, &T_p2_start);
+        MPI_TRACE_SCOPE(MPI_TRACE_COMPUTE, "gap statistics") {
+            prime_gaps_mpi(n, base_primes, base_count, MPI_COMM_WORLD, &gaps);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &T_file);
 
-    int local_start = root_n + 1 + rank * base + (rank < remainder ? rank : remainder);
-    int local_end = local_start + base - 1;
-    if (rank < remainder) local_end++;
+        if (rank == 0) {
+            printf("Primes below %d:  %lld\n", n, gaps.primes);
+            printf("Consecutive pairs with gap 2 (twin):  %lld\n", gaps.hist[1]);
+            printf("Consecutive pairs with gap 4 (cousin):  %lld\n", gaps.hist[2]);
+            printf("Consecutive pairs with gap 6 (sexy):  %lld\n", gaps.hist[3]);
+            printf("\nMaximal gaps (gap after prime):\n");
+            for (int i = 0; i < gaps.records.count; i++) {
+                printf("  %5lld  %lld\n", gaps.records.gap[i], gaps.records.after[i]);
+            }
+            printf("\nGap histogram (gap count):\n");
+            for (int i = 0; i < PRIME_GAPS_BINS; i++) {
+                if (gaps.hist[i] == 0) continue;
+                if (i == PRIME_GAPS_BINS - 1) printf("  >=%d  %lld\n", 2 * i, gaps.hist[i]);
+                else printf("  %5d  %lld\n", i == 0 ? 1 : 2 * i, gaps.hist[i]);
+            }
+            printf("\nPhase 1 (serial):      %.4f sec\n", time_diff(T_p1_start, T_p1_end));
+            printf("Gap statistics:        %.4f sec (segmented wheel sieve + reductions)\n", time_diff(T_p2_start, T_file));
+            printf("Total program time:    %.4f sec\n", time_diff(T_start, T_file));
+        }
+        mpi_trace_report(MPI_COMM_WORLD, stdout);
+        free(base_primes);
+        MPI_Finalize();
+        return 0;
+    }
 
-    int local_cap = (n / log(n)) / size + 1000;
-    int* local_primes = malloc(sizeof(int) * local_cap);
-    int local_count = 0;
+    if (use_goldbach) {
+        // --- Goldbach check: each rank sieves its block (plus a margin) and tests its evens locally ---
+        GoldbachResult gb;
+        clock_gettime(CLOCK_MONOTONIC, &T_p2_start);
+        MPI_TRACE_SCOPE(MPI_TRACE_COMPUTE, "goldbach check") {
+            goldbach_mpi(n, base_primes, base_count, MPI_COMM_WORLD, &gb);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &T_file);
 
-    // --- Phase 2 ---
-    clock_gettime(CLOCK_MONOTONIC, &T_p2_start);
-    for (int k = local_start; k <= local_end; k++) {
-        int is_prime = 1;
-        int sqrt_k = (int)sqrt(k);
-        for (int i = 0; i < base_count && base_primes[i] <= sqrt_k; i++) {
-            if (k % base_primes[i] == 0) {
-                is_prime = 0;
-                break;
+        if (rank == 0) {
+            if (gb.counterexample != INT_MAX) {
+                printf("Goldbach FAILS below %d: %d is not a sum of two primes\n", n, gb.counterexample);
+            } else {
+                printf("Goldbach holds for all %lld even numbers 4 <= m < %d\n", gb.evens, n);
             }
+            if (gb.max_p > 0) {
+                printf("Largest minimal p:     %d (first at m = %d = %d + %d)\n", gb.max_p, gb.max_p_at,
+                       gb.max_p, gb.max_p_at - gb.max_p);
+            }
+            printf("Beyond the p table:    %lld even numbers (table: primes up to %d)\n", gb.fallbacks,
+                   base_count > 0 ? base_primes[base_count - 1] : 0);
+            printf("\nPhase 1 (serial):      %.4f sec\n", time_diff(T_p1_start, T_p1_end));
+            printf("Goldbach check:        %.4f sec (slowest rank: sieve + check)\n", gb.seconds);
+            printf("Rate:                  %.3e even numbers/sec/core (%d rank(s))\n",
+                   gb.seconds > 0 ? gb.evens / gb.seconds / size : 0.0, size);
+            printf("Total program time:    %.4f sec\n", time_diff(T_start, T_file));
         }
-        if (is_prime) {
-            local_primes[local_count++] = k;
-        }
+        mpi_trace_report(MPI_COMM_WORLD, stdout);
+        free(base_primes);
+        MPI_Finalize();
+        return 0;
     }
-    clock_gettime(CLOCK_MONOTONIC, &T_p2_end);
 
-    // --- Gather result sizes ---
-    int* recv_counts = NULL;
-    int* displs = NULL;
-    if (rank == 0) {
-        recv_counts = malloc(sizeof(int) * size);
-        displs = malloc(sizeof(int) * size);
-    }
+    PrimeCacheStats cache_stats = {0, 0, 0};
+    long long arena_bytes = 0; // result arena of the block path
+    PerfCounters perf_counters = {{-1, -1, -1, -1, -1}, 0, 0};
+    long long perf_events[PERF_COUNTERS_EVENTS] = {0}; // Phase 2 on this rank, all its threads
+    if (use_perf && !use_hybrid) perf_counters_open(&perf_counters); // --hybrid: each thread opens its own
+    int num_nodes = 1, threads_per_rank = 1;
+    if (use_hybrid) {
+        // --- Hybrid: ranks on a node share base_primes and the node's slice of the bitset ---
+        MPI_Comm node_comm, leader_comm;
+        MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm);
+        int node_rank, node_size, node_id = 0;
+        MPI_Comm_rank(node_comm, &node_rank);
+        MPI_Comm_size(node_comm, &node_size);
 
-    MPI_Gather(&local_count, 1, MPI_INT, recv_counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        // One leader per node (its lowest rank); world rank 0 is always leader 0
+        MPI_Comm_split(MPI_COMM_WORLD, node_rank == 0 ? 0 : MPI_UNDEFINED, rank, &leader_comm);
+        if (node_rank == 0) {
+            MPI_Comm_rank(leader_comm, &node_id);
+            MPI_Comm_size(leader_comm, &num_nodes);
+        }
+        MPI_Bcast(&node_id, 1, MPI_INT, 0, node_comm);
+        MPI_Bcast(&num_nodes, 1, MPI_INT, 0, node_comm);
 
-    int total_phase2_primes = 0;
-    int* gathered_primes = NULL;
+        // Base primes: root -> leaders, straight into each node's shared window
+        if (node_rank == 0) MPI_Bcast(&base_count, 1, MPI_INT, 0, leader_comm);
+        MPI_Bcast(&base_count, 1, MPI_INT, 0, node_comm);
 
-    if (rank == 0) {
-        displs[0] = 0;
-        total_phase2_primes += recv_counts[0];
-        for (int i = 1; i < size; i++) {
-            displs[i] = displs[i - 1] + recv_counts[i - 1];
-            total_phase2_primes += recv_counts[i];
+        MPI_Win primes_win, bits_win;
+        MPI_Aint win_size;
+        int disp_unit;
+        int* shared_primes;
+        MPI_Win_allocate_shared(node_rank == 0 ? sizeof(int) * base_count : 0, sizeof(int),
+                                MPI_INFO_NULL, node_comm, &shared_primes, &primes_win);
+        MPI_Win_shared_query(primes_win, 0, &win_size, &disp_unit, &shared_primes);
+        MPI_TRACE_SCOPE(MPI_TRACE_COMM, "bcast base primes (leaders)") {
+            MPI_Win_fence(0, primes_win);
+            if (node_rank == 0) {
+                if (rank == 0) memcpy(shared_primes, base_primes, sizeof(int) * base_count);
+                MPI_Bcast(shared_primes, base_count, MPI_INT, 0, leader_comm);
+            }
+            MPI_Win_fence(0, primes_win);
         }
-        gathered_primes = malloc(sizeof(int) * total_phase2_primes);
-    }
 
-    MPI_Gatherv(local_primes, local_count, MPI_INT,
-                gathered_primes, recv_counts, displs, MPI_INT,
-                0, MPI_COMM_WORLD);
+        // Each node owns a contiguous slice of wheel bytes, each rank a sub-slice of it
+        long long total_bytes = wheel30_bytes(n);
+        long long node_lo = total_bytes * node_id / num_nodes;
+        long long node_hi = total_bytes * (node_id + 1) / num_nodes;
+        long long my_lo = node_lo + (node_hi - node_lo) * node_rank / node_size;
+        long long my_hi = node_lo + (node_hi - node_lo) * (node_rank + 1) / node_size;
 
-    if (rank == 0) {
-        // Merge phase 1 + 2 results
-        int total_primes = total_phase2_primes + base_count;
-        int* final_primes = malloc(sizeof(int) * total_primes);
+        unsigned char* node_bits;
+        MPI_Win_allocate_shared(node_rank == 0 ? node_hi - node_lo + 1 : 0, 1,
+                                MPI_INFO_NULL, node_comm, &node_bits, &bits_win);
+        MPI_Win_shared_query(bits_win, 0, &win_size, &disp_unit, &node_bits);
+        MPI_Win_fence(0, bits_win);
 
-        for (int i = 0; i < base_count; i++) {
-            final_primes[i] = base_primes[i];
+        // --- Phase 2: threads inside each rank take sieve segments of its sub-slice ---
+        clock_gettime(CLOCK_MONOTONIC, &T_p2_start);
+#ifdef _OPENMP
+        threads_per_rank = omp_get_max_threads();
+#endif
+        double trace_start = mpi_trace_begin();
+#pragma omp parallel
+        {
+            PerfCounters thread_counters;
+            long long thread_events[PERF_COUNTERS_EVENTS] = {0};
+            if (use_perf) {
+                perf_counters_open(&thread_counters);
+                perf_counters_start(&thread_counters);
+            }
+#pragma omp for schedule(dynamic)
+            for (long long seg = my_lo; seg < my_hi; seg += WHEEL30_SEGMENT_BYTES) {
+                long long seg_hi = seg + WHEEL30_SEGMENT_BYTES < my_hi ? seg + WHEEL30_SEGMENT_BYTES : my_hi;
+                wheel30_sieve(node_bits + (seg - node_lo), seg, seg_hi, shared_primes, base_count);
+            }
+            if (use_perf) {
+                perf_counters_stop(&thread_counters, thread_events);
+                perf_counters_close(&thread_counters);
+#pragma omp critical
+                {
+                    perf_counters_add(perf_events, thread_events);
+                    if (thread_counters.opened >= perf_counters.opened) perf_counters = thread_counters;
+                }
+            }
         }
-        for (int i = 0; i < total_phase2_primes; i++) {
-            final_primes[base_count + i] = gathered_primes[i];
+        mpi_trace_end(MPI_TRACE_COMPUTE, "phase 2: wheel sieve (threads)", trace_start);
+        clock_gettime(CLOCK_MONOTONIC, &T_p2_end);
+        MPI_TRACE_SCOPE(MPI_TRACE_COMM, "node fence") {
+            MPI_Win_fence(0, bits_win);
         }
 
-        clock_gettime(CLOCK_MONOTONIC, &T_sort);
-        qsort(final_primes, total_primes, sizeof(int), compare);
+        // --- Only the node leaders take part in the gather ---
+        if (node_rank == 0) {
+            int* recv_counts = NULL;
+            int* displs = NULL;
+            unsigned char* all_bits = NULL;
+            if (rank == 0) {
+                recv_counts = malloc(sizeof(int) * num_nodes);
+                displs = malloc(sizeof(int) * num_nodes);
+                for (int i = 0; i < num_nodes; i++) {
+                    displs[i] = (int)(total_bytes * i / num_nodes);
+                    recv_counts[i] = (int)(total_bytes * (i + 1) / num_nodes) - displs[i];
+                }
+                all_bits = malloc(total_bytes + 1);
+            }
+            MPI_TRACE_SCOPE(MPI_TRACE_COMM, "gatherv (leaders)") {
+                MPI_Gatherv(node_bits, (int)(node_hi - node_lo), MPI_UNSIGNED_CHAR,
+                            all_bits, recv_counts, displs, MPI_UNSIGNED_CHAR, 0, leader_comm);
+            }
 
-        clock_gettime(CLOCK_MONOTONIC, &T_file);
-        FILE* f = fopen("primes_mpi.txt", "w");
-        for (int i = 0; i < total_primes; i++) {
-            fprintf(f, "%d\n", final_primes[i]);
+            if (rank == 0) {
+                clock_gettime(CLOCK_MONOTONIC, &T_gather);
+                wheel30_truncate(all_bits, total_bytes, n);
+                T_sort = T_gather; // already in order
+                MPI_TRACE_SCOPE(MPI_TRACE_IO, "write file") {
+                    writeWheel(all_bits, total_bytes, n, use_archive);
+                }
+                clock_gettime(CLOCK_MONOTONIC, &T_file);
+                free(all_bits);
+                free(recv_counts);
+                free(displs);
+            }
+            MPI_Comm_free(&leader_comm);
         }
-        fclose(f);
 
+        MPI_Win_free(&bits_win);
+        MPI_Win_free(&primes_win);
+        MPI_Comm_free(&node_comm);
+    } else if (use_wheel) {
+        // --- Phase 2 (wheel): block+remainder over bytes of the mod-30 bitset covering [0, n) ---
+        int total_bytes = (int)wheel30_bytes(n);
+        int base = total_bytes / size;
+        int remainder = total_bytes % size;
+
+        int byte_lo = rank * base + (rank < remainder ? rank : remainder);
+        int byte_count = base + (rank < remainder ? 1 : 0);
+        unsigned char* local_bits = malloc(byte_count + 1);
+
+        clock_gettime(CLOCK_MONOTONIC, &T_p2_start);
+        if (use_perf) perf_counters_start(&perf_counters);
+        if (use_cache) {
+            // Take whole segments from the on-disk cache, sieving and storing only the missing ones
+            MPI_TRACE_SCOPE(MPI_TRACE_IO, "phase 2: cache fill") {
+                PrimeCache cache;
+                prime_cache_open(&cache, NULL, n);
+                prime_cache_fill(&cache, local_bits, byte_lo, byte_lo + byte_count, &cache_stats);
+                prime_cache_close(&cache);
+            }
+        } else {
+            MPI_TRACE_SCOPE(MPI_TRACE_COMPUTE, "phase 2: wheel sieve") {
+                wheel30_sieve(local_bits, byte_lo, byte_lo + byte_count, base_primes, base_count);
+            }
+        }
+        if (use_perf) perf_counters_stop(&perf_counters, perf_events);
+        clock_gettime(CLOCK_MONOTONIC, &T_p2_end);
+
+        if (use_mpiio) {
+            // --- Collective write: no gather, each rank prints its own bytes ---
+            T_gather = T_sort = T_p2_end;
+            char* text = malloc(wheel30_count(local_bits, byte_count) * 11 + 32);
+            char* end = text;
+            double trace_start = mpi_trace_begin();
+            if (rank == 0) {
+                for (int i = 0; i < wheel30_small_primes(n); i++) {
+                    end = appendPrime(end, WHEEL30_SMALL_PRIMES[i]);
+                }
+            }
+            for (int b = 0; b < byte_count; b++) {
+                for (unsigned int byte = local_bits[b]; byte != 0; byte &= byte - 1) {
+                    long long v = 30LL * (byte_lo + b) + WHEEL30_RESIDUES[__builtin_ctz(byte)];
+                    if (v < n) end = appendPrime(end, v);
+                }
+            }
+            mpi_trace_end(MPI_TRACE_COMPUTE, "format slice", trace_start);
+            MPI_TRACE_SCOPE(MPI_TRACE_IO, "collective write") {
+                writeCollective("primes_mpi.txt", text, end - text, MPI_COMM_WORLD);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &T_file);
+            free(text);
+            free(local_bits);
+        } else {
+            // --- Gather the bitset: every rank's bytes land at their final offset ---
+            int* recv_counts = NULL;
+            int* displs = NULL;
+            unsigned char* all_bits = NULL;
+            if (rank == 0) {
+                recv_counts = malloc(sizeof(int) * size);
+                displs = malloc(sizeof(int) * size);
+                for (int i = 0; i < size; i++) {
+                    recv_counts[i] = base + (i < remainder ? 1 : 0);
+                    displs[i] = i * base + (i < remainder ? i : remainder);
+                }
+                all_bits = malloc(total_bytes + 1);
+            }
+
+            MPI_TRACE_SCOPE(MPI_TRACE_COMM, "gatherv") {
+                MPI_Gatherv(local_bits, byte_count, MPI_UNSIGNED_CHAR,
+                            all_bits, recv_counts, displs, MPI_UNSIGNED_CHAR,
+                            0, MPI_COMM_WORLD);
+            }
+
+            if (rank == 0) {
+                clock_gettime(CLOCK_MONOTONIC, &T_gather);
+                wheel30_truncate(all_bits, total_bytes, n);
+
+                // Already in order, nothing to sort
+                clock_gettime(CLOCK_MONOTONIC, &T_sort);
+                MPI_TRACE_SCOPE(MPI_TRACE_IO, "write file") {
+                    writeWheel(all_bits, total_bytes, n, use_archive);
+                }
+                clock_gettime(CLOCK_MONOTONIC, &T_file);
+
+                free(all_bits);
+                free(recv_counts);
+                free(displs);
+            }
+
+            free(local_bits);
+        }
+    } else {
+        // --- Phase 2 Range Calculation (safe block+remainder) ---
+        int total_range = n - root_n - 1;
+        int base = total_range / size;
+        int remainder = total_range % size;
+
+        int local_start = root_n + 1 + rank * base + (rank < remainder ? rank : remainder);
+        int local_end = local_start + base - 1;
+        if (rank < remainder) local_end++;
+
+        PrimeArena local_primes; // grows with the primes found, no up-front bound
+        prime_arena_init(&local_primes);
+
+        // --- Phase 2 ---
+        clock_gettime(CLOCK_MONOTONIC, &T_p2_start);
+        if (use_perf) perf_counters_start(&perf_counters);
+        MPI_TRACE_SCOPE(MPI_TRACE_COMPUTE, use_sieve ? "phase 2: segmented sieve" : "phase 2: trial division") {
+            if (use_sieve) {
+                // One arena reservation per sieve segment: at most half its numbers (+1) can be prime
+                for (int lo = local_start; lo <= local_end; lo += PRIME_KERNEL_SEGMENT) {
+                    int hi = (local_end - lo >= PRIME_KERNEL_SEGMENT) ? lo + PRIME_KERNEL_SEGMENT - 1 : local_end;
+                    int* out = prime_arena_reserve(&local_primes, PRIME_KERNEL_SEGMENT / 2 + 1);
+                    prime_arena_commit(&local_primes, prime_sieve_range(lo, hi, base_primes, base_count, out));
+                }
+            } else {
+                for (int k = local_start; k <= local_end; k++) {
+                    if (prime_test_by(k, base_primes, base_count)) {
+                        prime_arena_push(&local_primes, k);
+                    }
+                }
+            }
+        }
+        if (use_perf) perf_counters_stop(&perf_counters, perf_events);
+        int local_count = (int)local_primes.count;
+        arena_bytes = prime_arena_bytes(&local_primes);
+        clock_gettime(CLOCK_MONOTONIC, &T_p2_end);
+
+        if (use_mpiio) {
+            // --- Collective write: no gather, blocks are in rank order so slices concatenate sorted ---
+            T_gather = T_sort = T_p2_end;
+            int text_count = local_count + (rank == 0 ? base_count : 0);
+            char* text = malloc((long long)text_count * 11 + 1);
+            char* end = text;
+            MPI_TRACE_SCOPE(MPI_TRACE_COMPUTE, "format slice") {
+                if (rank == 0) {
+                    for (int i = 0; i < base_count; i++) end = appendPrime(end, base_primes[i]);
+                }
+                for (PrimeArenaBlock* b = local_primes.head; b != NULL; b = b->next) {
+                    for (int i = 0; i < b->count; i++) end = appendPrime(end, b->values[i]);
+                }
+            }
+            MPI_TRACE_SCOPE(MPI_TRACE_IO, "collective write") {
+                writeCollective("primes_mpi.txt", text, end - text, MPI_COMM_WORLD);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &T_file);
+            free(text);
+            prime_arena_free(&local_primes);
+        } else {
+            // --- Gather result sizes ---
+            int* recv_counts = NULL;
+            int* displs = NULL;
+            if (rank == 0) {
+                recv_counts = malloc(sizeof(int) * size);
+                displs = malloc(sizeof(int) * size);
+            }
+
+            MPI_TRACE_SCOPE(MPI_TRACE_COMM, "gather counts") {
+                MPI_Gather(&local_count, 1, MPI_INT, recv_counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+            }
+
+            int total_phase2_primes = 0;
+            int* gathered_primes = NULL;
+            int* final_primes = NULL;
+
+            if (rank == 0) {
+                displs[0] = 0;
+                total_phase2_primes += recv_counts[0];
+                for (int i = 1; i < size; i++) {
+                    displs[i] = displs[i - 1] + recv_counts[i - 1];
+                    total_phase2_primes += recv_counts[i];
+                }
+                final_primes = malloc(sizeof(int) * (total_phase2_primes + base_count));
+
+                // Ordered gather: blocks are contiguous and in rank order, so each rank's
+                // primes can land straight at their final position after the base primes
+                gathered_primes = use_ordered ? final_primes + base_count
+                                              : malloc(sizeof(int) * total_phase2_primes);
+            }
+
+            // The arena's blocks go out in place, described by an hindexed datatype
+            MPI_Datatype arena_type = prime_arena_mpi_type(&local_primes);
+            MPI_TRACE_SCOPE(MPI_TRACE_COMM, "gatherv") {
+                MPI_Gatherv(MPI_BOTTOM, 1, arena_type,
+                            gathered_primes, recv_counts, displs, MPI_INT,
+                            0, MPI_COMM_WORLD);
+            }
+            MPI_Type_free(&arena_type);
+
+            if (rank == 0) {
+                // Merge phase 1 + 2 results
+                int total_primes = total_phase2_primes + base_count;
+
+                for (int i = 0; i < base_count; i++) {
+                    final_primes[i] = base_primes[i];
+                }
+                if (!use_ordered) {
+                    for (int i = 0; i < total_phase2_primes; i++) {
+                        final_primes[base_count + i] = gathered_primes[i];
+                    }
+                }
+
+                clock_gettime(CLOCK_MONOTONIC, &T_gather);
+                double trace_start = mpi_trace_begin();
+                if (!use_ordered) {
+                    qsort(final_primes, total_primes, sizeof(int), compare);
+                }
+                mpi_trace_end(MPI_TRACE_COMPUTE, "sort", trace_start);
+
+                clock_gettime(CLOCK_MONOTONIC, &T_sort);
+                trace_start = mpi_trace_begin();
+                if (use_archive) {
+                    PrimeArchiveWriter w;
+                    prime_archive_create(&w, "primes_mpi.pa");
+                    for (int i = 0; i < total_primes; i++) {
+                        prime_archive_append(&w, final_primes[i]);
+                    }
+                    prime_archive_finish(&w, n);
+                } else {
+                    FILE* f = fopen("primes_mpi.txt", "w");
+                    for (int i = 0; i < total_primes; i++) {
+                        fprintf(f, "%d\n", final_primes[i]);
+                    }
+                    fclose(f);
+                }
+                mpi_trace_end(MPI_TRACE_IO, "write file", trace_start);
+                clock_gettime(CLOCK_MONOTONIC, &T_file);
+
+                free(final_primes);
+                if (!use_ordered) free(gathered_primes);
+                free(recv_counts);
+                free(displs);
+            }
+
+            prime_arena_free(&local_primes);
+        }
+    }
+
+    // A segment straddling two ranks' blocks is counted by both
+    long long cache_totals[3] = {0, 0, 0};
+    if (use_cache) {
+        long long cache_local[3] = {cache_stats.loaded, cache_stats.sieved, cache_stats.rejected};
+        MPI_Reduce(cache_local, cache_totals, 3, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    }
+    long long mem_local[2] = {prime_peak_rss_kb(), arena_bytes};
+    long long mem_max[2] = {0, 0};
+    MPI_Reduce(mem_local, mem_max, 2, MPI_LONG_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
         printf("Phase 1 (serial):      %.4f sec\n", time_diff(T_p1_start, T_p1_end));
-        printf("Phase 2 (parallel):    %.4f sec\n", time_diff(T_p2_start, T_p2_end));
-        printf("Sort time:             %.4f sec\n", time_diff(T_p2_end, T_sort));
-        printf("File write time:       %.4f sec\n", time_diff(T_sort, T_file));
+        printf("Phase 2 (parallel):    %.4f sec (%s)\n", time_diff(T_p2_start, T_p2_end),
+               use_hybrid ? "wheel-30 bitset, node-shared windows + threads" : use_cache ? "wheel-30 bitset, on-disk segment cache" : use_wheel ? "wheel-30 bitset sieve" : use_sieve ? "segmented sieve" : "trial division");
+        if (use_hybrid) {
+            printf("Hybrid layout:         %d node(s), %d rank(s), %d thread(s) per rank; one shared copy per node\n",
+                   num_nodes, size, threads_per_rank);
+        }
+        if (use_cache) {
+            printf("Prime cache:           %lld segments loaded, %lld sieved (%lld invalid)\n",
+                   cache_totals[0], cache_totals[1], cache_totals[2]);
+        }
+        printf("Gather time:           %.4f sec%s\n", time_diff(T_p2_end, T_gather),
+               use_mpiio ? " (skipped)" : use_hybrid ? " (node leaders only)" : "");
+        printf("Sort time:             %.4f sec%s\n", time_diff(T_gather, T_sort),
+               use_mpiio ? " (skipped)" : use_wheel ? " (wheel bitset, no sort)" : use_ordered ? " (ordered gather, no sort)" : "");
+        printf("File write time:       %.4f sec%s\n", time_diff(T_sort, T_file),
+               use_mpiio ? " (per-rank formatting + collective MPI-IO)" : use_archive ? " (binary archive primes_mpi.pa)" : "");
         printf("Total program time:    %.4f sec\n", time_diff(T_start, T_file));
-
-        free(final_primes);
-        free(gathered_primes);
-        free(recv_counts);
-        free(displs);
+        printf("Peak RSS:              %.1f MiB max per rank", mem_max[0] / 1024.0);
+        if (!use_wheel) printf(" (result arena: %.1f MiB max)", mem_max[1] / 1048576.0);
+        printf("\n");
+    }
+    if (use_perf) {
+        perf_counters_report_mpi(&perf_counters, perf_events, "Phase 2", MPI_COMM_WORLD, stdout);
+        perf_counters_close(&perf_counters);
     }
+    mpi_trace_report(MPI_COMM_WORLD, stdout);
 
     free(base_primes);
-    free(local_primes);
 
     MPI_Finalize();
     return 0;
@@ -1,10 +1,31 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include <math.h>
 #include <mpi.h>
+#include "../common/prime_count.h"
+#include "../common/prime_kernel.h"
+#include "../common/mpi_trace.h"
+#include "../common/prime_arena.h"
+#include "../common/bucket_sieve.h"
 
-int is_prime(int n);
+#define RANGE_SEGMENT 262144   // numbers per pre-filter sieve segment
+#define RANGE_SIEVE_LIMIT 65536 // pre-filter with every prime below this
+
+#define DYNAMIC_MIN_CHUNK 2048 // smallest chunk the master hands out
+#define DYNAMIC_PREFETCH 2     // chunk requests each worker keeps outstanding
+#define TAG_REQUEST 1
+#define TAG_CHUNK 2
+#define RESERVE_SPAN 4096 // numbers per arena reservation in test_chunk's batch path
+
+int search_range(int argc, char *argv[], int rank, int no_of_processes);
+int search_dynamic(int n, int use_batch, int rank, int no_of_processes);
+int dynamic_master(int n, int workers);
+int test_chunk(int lo, int hi, const PrimeDivisors *divisors, PrimeArena *primes);
+void report_rss(int rank, long long arena_bytes);
 int compare_ints(const void *a, const void *b);
+void interleave_runs(const int *src, int total, int n, int *dst);
 
 int main(int argc, char *argv[])
 {
@@ -12,39 +33,196 @@ int main(int argc, char *argv[])
     int rank, no_of_processes;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &no_of_processes);
+    mpi_trace_init(MPI_COMM_WORLD);
+
+    if (argc >= 2 && strcmp(argv[1], "--range") == 0)
+    {
+        int status = search_range(argc, argv, rank, no_of_processes);
+        if (status == 0)
+            mpi_trace_report(MPI_COMM_WORLD, stderr);
+        MPI_Finalize();
+        return status;
+    }
 
     int n;
+    int use_wheel = 0, use_ordered = 0, use_count = 0, use_batch = 0, use_dynamic = 0, bad_args = (argc < 2);
+    for (int i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--wheel") == 0)
+            use_wheel = 1;
+        else if (strcmp(argv[i], "--ordered") == 0)
+            use_ordered = 1;
+        else if (strcmp(argv[i], "--count") == 0)
+            use_count = 1;
+        else if (strcmp(argv[i], "--batch") == 0)
+            use_batch = 1;
+        else if (strcmp(argv[i], "--dynamic") == 0)
+            use_dynamic = 1;
+        else
+            bad_args = 1;
+    }
+    if (use_count && use_wheel + use_ordered + use_batch + use_dynamic > 0)
+        bad_args = 1; // count only, nothing is listed
+    if (use_wheel && use_ordered + use_batch + use_dynamic > 0)
+        bad_args = 1; // the bitset comes out in order and has its own engine
+    if (use_dynamic && use_ordered)
+        bad_args = 1; // the root already places chunks by their lo
 
     // Root reads input
     if (rank == 0)
     {
-        if (argc != 2)
+        if (bad_args)
         {
-            printf("Usage: %s <upper bound>\n", argv[0]);
+            printf("Usage: %s <upper bound> [--ordered] [--batch] | --dynamic [--batch] | --wheel | --count\n", argv[0]);
+            printf("       %s --range <lo> <hi> [--bucket]\n", argv[0]);
             MPI_Abort(MPI_COMM_WORLD, 1);
         }
         n = atoi(argv[1]);
-        if (n <= 0)
+        if (atoll(argv[1]) <= 0)
         {
             printf("Please enter a positive integer.\n");
             MPI_Abort(MPI_COMM_WORLD, 1);
         }
     }
 
+    if (use_count)
+    {
+        // Count only: pi(n - 1) without listing any primes, so n may go well past INT_MAX
+        long long count_n = atoll(argv[1]);
+        double count_start = MPI_Wtime();
+        long long count = 0;
+        MPI_TRACE_SCOPE(MPI_TRACE_COMPUTE, "prime count")
+        {
+            count = prime_count_mpi(count_n - 1, MPI_COMM_WORLD);
+        }
+        if (rank == 0)
+        {
+            printf("Number of primes less than %lld: %lld\n", count_n, count);
+            fprintf(stderr, "Count time: %.4f sec\n", MPI_Wtime() - count_start);
+        }
+        mpi_trace_report(MPI_COMM_WORLD, stderr);
+        MPI_Finalize();
+        return 0;
+    }
+
     // Broadcast n to all processes
-    MPI_Bcast(&n, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_TRACE_SCOPE(MPI_TRACE_COMM, "bcast n")
+    {
+        MPI_Bcast(&n, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    }
 
-    // Each process finds local primes
-    int *local_primes = malloc(n * sizeof(int)); // oversize buffer
-    int local_count = 0;
+    if (use_dynamic)
+    {
+        int status = search_dynamic(n, use_batch, rank, no_of_processes);
+        mpi_trace_report(MPI_COMM_WORLD, stderr);
+        MPI_Finalize();
+        return status;
+    }
 
-    for (int i = 2 + rank; i < n; i += no_of_processes)
+    if (use_wheel)
     {
-        if (is_prime(i))
+        // Each process sieves its own contiguous block of the mod-30 bitset, as mpi.c --wheel
+        // does: sieving costs the same per byte everywhere, so equal blocks stay balanced
+        long long total_bytes = wheel30_bytes(n);
+        long long byte_lo = total_bytes * rank / no_of_processes;
+        long long byte_hi = total_bytes * (rank + 1) / no_of_processes;
+        unsigned char *local_bits = malloc(byte_hi - byte_lo + 1);
+
+        MPI_TRACE_SCOPE(MPI_TRACE_COMPUTE, "sieve block (wheel)")
         {
-            local_primes[local_count++] = i;
+            int base_count;
+            int *base_primes = prime_sieve_small((int)sqrt(30.0 * total_bytes) + 1, &base_count);
+            wheel30_sieve(local_bits, byte_lo, byte_hi, base_primes, base_count);
+            free(base_primes);
+        }
+
+        // Blocks are in rank order, so every block lands at its final offset
+        unsigned char *global_bits = NULL;
+        int *recv_counts = NULL;
+        int *displs = NULL;
+        if (rank == 0)
+        {
+            global_bits = malloc(total_bytes + 1);
+            recv_counts = malloc(no_of_processes * sizeof(int));
+            displs = malloc(no_of_processes * sizeof(int));
+            for (int i = 0; i < no_of_processes; i++)
+            {
+                displs[i] = (int)(total_bytes * i / no_of_processes);
+                recv_counts[i] = (int)(total_bytes * (i + 1) / no_of_processes) - displs[i];
+            }
+        }
+        MPI_TRACE_SCOPE(MPI_TRACE_COMM, "gatherv bitset")
+        {
+            MPI_Gatherv(local_bits, (int)(byte_hi - byte_lo), MPI_UNSIGNED_CHAR,
+                        global_bits, recv_counts, displs, MPI_UNSIGNED_CHAR,
+                        0, MPI_COMM_WORLD);
+        }
+        if (rank == 0)
+        {
+            free(recv_counts);
+            free(displs);
+            wheel30_truncate(global_bits, total_bytes, n);
+
+            double trace_start = mpi_trace_begin();
+            printf("Primes less than %d:\n", n);
+            wheel30_print_small(stdout, n, ' ');
+            long long v;
+            WHEEL30_FOR_EACH(global_bits, total_bytes, v)
+            {
+                printf("%lld ", v);
+            }
+            printf("\n");
+            fflush(stdout);
+            mpi_trace_end(MPI_TRACE_IO, "print primes", trace_start);
+
+            free(global_bits);
+        }
+
+        free(local_bits);
+        mpi_trace_report(MPI_COMM_WORLD, stderr);
+        MPI_Finalize();
+        return 0;
+    }
+
+    // Each process finds local primes; the arena grows with the primes actually found
+    PrimeArena local_primes;
+    prime_arena_init(&local_primes);
+
+    double trace_start = mpi_trace_begin();
+    if (use_batch)
+    {
+        // Same cyclic candidates, tested PRIME_BATCH_WIDTH at a time by the SIMD kernel
+        PrimeDivisors divisors;
+        prime_divisors_init(&divisors, n);
+        uint32_t candidates[PRIME_BATCH_WIDTH];
+        unsigned char prime_flags[PRIME_BATCH_WIDTH];
+
+        for (long long i = 2 + rank; i < n;)
+        {
+            int lanes = 0;
+            for (; lanes < PRIME_BATCH_WIDTH && i < n; lanes++, i += no_of_processes)
+                candidates[lanes] = (uint32_t)i;
+            prime_batch(&divisors, candidates, lanes, prime_flags);
+            for (int j = 0; j < lanes; j++)
+            {
+                if (prime_flags[j])
+                    prime_arena_push(&local_primes, (int)candidates[j]);
+            }
+        }
+        prime_divisors_free(&divisors);
+    }
+    else
+    {
+        for (int i = 2 + rank; i < n; i += no_of_processes)
+        {
+            if (prime_test_u32(i))
+            {
+                prime_arena_push(&local_primes, i);
+            }
         }
     }
+    mpi_trace_end(MPI_TRACE_COMPUTE, use_batch ? "test candidates (batch)" : "test candidates", trace_start);
+    int local_count = (int)local_primes.count;
 
     // Step 1: gather counts
     int *recv_counts = NULL;
@@ -52,9 +230,12 @@ int main(int argc, char *argv[])
     {
         recv_counts = malloc(no_of_processes * sizeof(int));
     }
-    MPI_Gather(&local_count, 1, MPI_INT,
-               recv_counts, 1, MPI_INT,
-               0, MPI_COMM_WORLD);
+    MPI_TRACE_SCOPE(MPI_TRACE_COMM, "gather counts")
+    {
+        MPI_Gather(&local_count, 1, MPI_INT,
+                   recv_counts, 1, MPI_INT,
+                   0, MPI_COMM_WORLD);
+    }
 
     // Step 2: prepare offsets and gather all primes at root
     int *global_primes = NULL; // will store all primes collected at root
@@ -72,69 +253,596 @@ int main(int argc, char *argv[])
         // Each subsequent process starts where the previous one ended
         for (int i = 1; i < no_of_processes; i++)
         {
-            offsets[i] = offsets[i - 1] + counts_per_process[i - 1];
+            offsets[i] = offsets[i - 1] + recv_counts[i - 1];
         }
 
         // Compute total number of primes across all processes
         for (int i = 0; i < no_of_processes; i++)
         {
-            total_prime_count += counts_per_process[i];
+            total_prime_count += recv_counts[i];
         }
 
         // Allocate space to hold all primes together
         global_primes = malloc(total_prime_count * sizeof(int));
     }
 
-    // Gather all primes from each process into root process (rank 0)
-    MPI_Gatherv(local_primes, local_count, MPI_INT,                  // send buffer
-                global_primes, counts_per_process, offsets, MPI_INT, // recv buffer (root only)
-                0, MPI_COMM_WORLD);
+    // Gather all primes from each process into root process (rank 0), straight from the arena blocks
+    MPI_Datatype arena_type = prime_arena_mpi_type(&local_primes);
+    MPI_TRACE_SCOPE(MPI_TRACE_COMM, "gatherv")
+    {
+        MPI_Gatherv(MPI_BOTTOM, 1, arena_type,                        // send buffer
+                    global_primes, recv_counts, offsets, MPI_INT, // recv buffer (root only)
+                    0, MPI_COMM_WORLD);
+    }
+    MPI_Type_free(&arena_type);
 
     // Step 3: root sorts and prints
     if (rank == 0)
     {
-        qsort(all_primes, total_primes, sizeof(int), compare_ints);
+        double sort_start = mpi_trace_begin();
+        if (use_ordered)
+        {
+            // The runs of the cyclic layout interleave, so place them in linear time instead of sorting
+            int *merged = malloc((total_prime_count + 1) * sizeof(int));
+            interleave_runs(global_primes, total_prime_count, n, merged);
+            free(global_primes);
+            global_primes = merged;
+            mpi_trace_end(MPI_TRACE_COMPUTE, "interleave runs", sort_start);
+            fprintf(stderr, "Sort time: %.4f sec (interleaved runs, no sort)\n",
+                    MPI_Wtime() - sort_start);
+        }
+        else
+        {
+            qsort(global_primes, total_prime_count, sizeof(int), compare_ints);
+            mpi_trace_end(MPI_TRACE_COMPUTE, "sort", sort_start);
+            fprintf(stderr, "Sort time: %.4f sec (qsort)\n", MPI_Wtime() - sort_start);
+        }
 
-        printf("Primes less than %d:\n", n);
-        for (int i = 0; i < total_primes; i++)
+        MPI_TRACE_SCOPE(MPI_TRACE_IO, "print primes")
         {
-            printf("%d ", all_primes[i]);
+            printf("Primes less than %d:\n", n);
+            for (int i = 0; i < total_prime_count; i++)
+            {
+                printf("%d ", global_primes[i]);
+            }
+            printf("\n");
+            fflush(stdout);
         }
-        printf("\n");
 
-        free(all_primes);
+        free(global_primes);
         free(recv_counts);
-        free(displacements);
+        free(offsets);
     }
 
-    free(local_primes);
+    report_rss(rank, prime_arena_bytes(&local_primes));
+    prime_arena_free(&local_primes);
+    mpi_trace_report(MPI_COMM_WORLD, stderr);
     MPI_Finalize();
     return 0;
 }
 
-// Prime checker
-int is_prime(int n)
+// 64-bit window [lo, hi): each process takes one contiguous, equal-length sub-window
+// (prime density is practically flat across a window, so this balances the work),
+// sieves out multiples of the primes below RANGE_SIEVE_LIMIT segment by segment and
+// runs deterministic Miller-Rabin on whatever survives. With --bucket the sub-window is
+// sieved exactly instead, by every prime up to sqrt(hi), with the large ones in buckets
+// (bucket_sieve.h); past about 10^12 that beats both the pre-filter + Miller-Rabin and a
+// plain segmented sieve, which would scan all of pi(sqrt(hi)) for every segment.
+int search_range(int argc, char *argv[], int rank, int no_of_processes)
 {
-    if (n < 2)
-        return 0;
-    if (n == 2)
+    int use_bucket = (argc == 5 && strcmp(argv[4], "--bucket") == 0);
+    if (argc != 4 && !use_bucket)
+    {
+        if (rank == 0)
+            printf("Usage: %s --range <lo> <hi> [--bucket]\n", argv[0]);
         return 1;
-    if (n % 2 == 0)
-        return 0;
+    }
+
+    uint64_t lo = strtoull(argv[2], NULL, 10);
+    uint64_t hi = strtoull(argv[3], NULL, 10);
+    if (lo < 2)
+        lo = 2;
+    if (hi <= lo)
+    {
+        if (rank == 0)
+            printf("Empty range [%s, %s).\n", argv[2], argv[3]);
+        return 1;
+    }
+
+    if (use_bucket && hi > BUCKET_SIEVE_MAX_HI)
+    {
+        if (rank == 0)
+            printf("--bucket needs hi <= %llu (sieving primes below 2^31).\n", BUCKET_SIEVE_MAX_HI);
+        return 1;
+    }
+
+    uint64_t span = hi - lo;
+    uint64_t my_lo = lo + (uint64_t)((mr_u128)span * rank / no_of_processes);
+    uint64_t my_hi = lo + (uint64_t)((mr_u128)span * (rank + 1) / no_of_processes);
+
+    // Small primes for the pre-filter
+    int small_count = 0;
+    int *small_primes = prime_sieve_small(RANGE_SIEVE_LIMIT - 1, &small_count);
+
+    int capacity = 1024, local_count = 0;
+    uint64_t *local_primes = malloc(capacity * sizeof(uint64_t));
+    long long mr_tests = 0;
+    unsigned char *segment = malloc(RANGE_SEGMENT);
+
+    // --bucket: every rank builds the sieving primes up to sqrt(hi - 1) itself
+    uint32_t *sieving_primes = NULL;
+    long long sieving_count = 0, bucket_hits = 0;
+    int bucket_blocks = 0, num_buckets = 0;
+    if (use_bucket)
+    {
+        MPI_TRACE_SCOPE(MPI_TRACE_COMPUTE, "sieving primes")
+        {
+            uint32_t root = (uint32_t)sqrt((double)(hi - 1));
+            while ((uint64_t)root * root > hi - 1)
+                root--;
+            while ((uint64_t)(root + 1) * (root + 1) <= hi - 1)
+                root++;
+            sieving_primes = bucket_sieve_primes(root, &sieving_count);
+        }
+    }
+
+    double start = mpi_trace_begin();
+    if (use_bucket)
+    {
+        BucketSieve bs;
+        bucket_sieve_init(&bs, my_lo, my_hi, sieving_primes, sieving_count);
+        uint64_t *found = malloc(sizeof(uint64_t) * (BUCKET_SIEVE_SEGMENT_BYTES + 1));
+        long long count;
+        while ((count = bucket_sieve_next(&bs, found)) >= 0)
+        {
+            while (local_count + count > capacity)
+            {
+                capacity *= 2;
+                local_primes = realloc(local_primes, capacity * sizeof(uint64_t));
+            }
+            memcpy(local_primes + local_count, found, count * sizeof(uint64_t));
+            local_count += (int)count;
+        }
+        bucket_hits = bs.hits;
+        bucket_blocks = bs.blocks;
+        num_buckets = bs.num_buckets;
+        free(found);
+        bucket_sieve_free(&bs);
+    }
+    else
+    {
+        for (uint64_t seg_lo = my_lo; seg_lo < my_hi; seg_lo = (my_hi - seg_lo > RANGE_SEGMENT) ? seg_lo + RANGE_SEGMENT : my_hi)
+        {
+            uint64_t seg_hi = (my_hi - seg_lo > RANGE_SEGMENT) ? seg_lo + RANGE_SEGMENT : my_hi;
+            memset(segment, 1, seg_hi - seg_lo);
+
+            for (int i = 0; i < small_count; i++)
+            {
+                uint64_t p = small_primes[i];
+                if (p * p >= seg_hi)
+                    break;
+                uint64_t first = seg_lo + (p - seg_lo % p) % p;
+                if (first < p * p)
+                    first = p * p;
+                // Index from seg_lo so the walk cannot wrap past 2^64
+                for (uint64_t j = first - seg_lo; j < seg_hi - seg_lo; j += p)
+                    segment[j] = 0;
+            }
+
+            for (uint64_t k = seg_lo; k < seg_hi; k++)
+            {
+                if (!segment[k - seg_lo])
+                    continue;
+                // Below RANGE_SIEVE_LIMIT^2 the sieve alone is exact
+                if (k >= (uint64_t)RANGE_SIEVE_LIMIT * RANGE_SIEVE_LIMIT)
+                {
+                    mr_tests++;
+                    if (!prime_test_u64(k))
+                        continue;
+                }
+                if (local_count == capacity)
+                {
+                    capacity *= 2;
+                    local_primes = realloc(local_primes, capacity * sizeof(uint64_t));
+                }
+                local_primes[local_count++] = k;
+            }
+        }
+    }
+    double elapsed = MPI_Wtime() - start;
+    mpi_trace_end(MPI_TRACE_COMPUTE, use_bucket ? "bucket sieve" : "sieve + Miller-Rabin", start);
+    free(segment);
+    free(small_primes);
+    free(sieving_primes);
+
+    long long bucket_local[2] = {bucket_hits, bucket_blocks}, bucket_totals[2] = {0, 0};
+    int max_buckets = 0;
+    if (use_bucket)
+    {
+        MPI_Reduce(bucket_local, bucket_totals, 2, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+        MPI_Reduce(&num_buckets, &max_buckets, 1, MPI_INT, MPI_MAX, 0, MPI_COMM_WORLD);
+    }
+
+    // Sub-windows are contiguous and in rank order, so the gather is already sorted
+    int *recv_counts = NULL, *offsets = NULL;
+    double *times = NULL;
+    long long *tests = NULL;
+    uint64_t *all_primes = NULL;
+    if (rank == 0)
+    {
+        recv_counts = malloc(no_of_processes * sizeof(int));
+        offsets = malloc(no_of_processes * sizeof(int));
+        times = malloc(no_of_processes * sizeof(double));
+        tests = malloc(no_of_processes * sizeof(long long));
+    }
+    double trace_start = mpi_trace_begin();
+    MPI_Gather(&local_count, 1, MPI_INT, recv_counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Gather(&elapsed, 1, MPI_DOUBLE, times, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Gather(&mr_tests, 1, MPI_LONG_LONG, tests, 1, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
 
-    int sqrt_n = (int)sqrt(n);
-    for (int i = 3; i <= sqrt_n; i += 2)
+    int total = 0;
+    if (rank == 0)
     {
-        if (n % i == 0)
-            return 0;
+        for (int i = 0; i < no_of_processes; i++)
+        {
+            offsets[i] = total;
+            total += recv_counts[i];
+        }
+        all_primes = malloc((total + 1) * sizeof(uint64_t));
     }
-    return 1;
+    MPI_Gatherv(local_primes, local_count, MPI_UINT64_T,
+                all_primes, recv_counts, offsets, MPI_UINT64_T,
+                0, MPI_COMM_WORLD);
+    mpi_trace_end(MPI_TRACE_COMM, "gather primes", trace_start);
+
+    if (rank == 0)
+    {
+        MPI_TRACE_SCOPE(MPI_TRACE_IO, "print primes")
+        {
+            printf("Primes in [%llu, %llu):\n", (unsigned long long)lo, (unsigned long long)hi);
+            for (int i = 0; i < total; i++)
+            {
+                printf("%llu ", (unsigned long long)all_primes[i]);
+            }
+            printf("\n");
+            fflush(stdout);
+        }
+
+        double slowest = 0;
+        long long total_tests = 0;
+        fprintf(stderr, "Rank   Candidates      MR tests   Primes     Time(s)   Candidates/sec\n");
+        for (int i = 0; i < no_of_processes; i++)
+        {
+            uint64_t r_lo = lo + (uint64_t)((mr_u128)span * i / no_of_processes);
+            uint64_t r_hi = lo + (uint64_t)((mr_u128)span * (i + 1) / no_of_processes);
+            fprintf(stderr, "%4d   %-12llu    %-10lld %-10d %-9.4f %.3e\n", i,
+                    (unsigned long long)(r_hi - r_lo), tests[i], recv_counts[i], times[i],
+                    times[i] > 0 ? (r_hi - r_lo) / times[i] : 0.0);
+            if (times[i] > slowest)
+                slowest = times[i];
+            total_tests += tests[i];
+        }
+        fprintf(stderr, "Total: %d primes, %lld Miller-Rabin tests, %.4f sec, %.3e candidates/sec\n",
+                total, total_tests, slowest, slowest > 0 ? span / slowest : 0.0);
+        if (use_bucket)
+        {
+            fprintf(stderr, "Bucket sieve: %lld sieving primes, those >= %d bucketed in a ring of up to %d segments; "
+                            "%lld bucket hits, %.1f MiB of bucket blocks over all ranks\n",
+                    sieving_count, BUCKET_SIEVE_SEGMENT_BYTES, max_buckets, bucket_totals[0],
+                    bucket_totals[1] * sizeof(BucketBlock) / 1048576.0);
+        }
+
+        free(all_primes);
+        free(recv_counts);
+        free(offsets);
+        free(times);
+        free(tests);
+    }
+
+    free(local_primes);
+    return 0;
 }
 
+
 // Comparison function for qsort
 int compare_ints(const void *a, const void *b)
 {
     int x = *(const int *)a;
     int y = *(const int *)b;
     return (x > y) - (x < y);
-}
\ No newline at end of file
+}
+
+// Put the runs of the cyclic distribution, src[0 .. total), in ascending order into dst.
+// Run r holds exactly the primes of the form 2 + r + k * P, ascending, so the runs
+// interleave value by value and no heads need comparing: every value sets its bit in a
+// mod-30 wheel bitset and one in-order scan reads them back. That is O(total + n / 30),
+// linear in the number of primes, as n / 30 stays below n / ln n for every int n.
+void interleave_runs(const int *src, int total, int n, int *dst)
+{
+    long long nbytes = wheel30_bytes(n);
+    unsigned char *bits = calloc(nbytes + 1, 1);
+    int small = 0; // 2, 3 and 5 have no bit in the wheel
+    for (int i = 0; i < total; i++)
+    {
+        if (src[i] < 7)
+            small |= 1 << src[i];
+        else
+            wheel30_set(bits, src[i]);
+    }
+    int out = 0;
+    for (int p = 2; p < 7; p++)
+    {
+        if (small & (1 << p))
+            dst[out++] = p;
+    }
+    long long v;
+    WHEEL30_FOR_EACH(bits, nbytes, v)
+    {
+        dst[out++] = (int)v;
+    }
+    free(bits);
+}
+
+// Master/worker search of [2, n) with guided self-scheduling, in the style of w10/master_slave.c.
+// Rank 0 only hands out chunks [lo, hi); the other ranks test them. Every worker keeps
+// DYNAMIC_PREFETCH requests outstanding, so the next chunk is already waiting when it
+// finishes the current one. Chunk sizes are remaining / (2 * workers), shrinking towards
+// DYNAMIC_MIN_CHUNK, so the last chunks are small and everyone finishes close together.
+// Workers record (lo, hi, count, offset) per chunk; the root orders the chunks by lo and
+// concatenates their primes, so no sort is needed.
+int search_dynamic(int n, int use_batch, int rank, int no_of_processes)
+{
+    int workers = no_of_processes - 1;
+    PrimeDivisors divisors;
+    if (use_batch)
+        prime_divisors_init(&divisors, n);
+
+    PrimeArena local_primes;
+    prime_arena_init(&local_primes);
+    int rec_capacity = 64, rec_count = 0;
+    int *records = malloc(rec_capacity * 4 * sizeof(int)); // lo, hi, count, offset per chunk
+    int handed_out = 0; // chunks the master gave away
+    double busy = 0, wait = 0;
+    double start = MPI_Wtime();
+
+    if (workers == 0)
+    {
+        // Nobody to hand chunks to: the lone rank searches the whole range as one chunk
+        records[0] = 2;
+        records[1] = n > 2 ? n : 2;
+        MPI_TRACE_SCOPE(MPI_TRACE_COMPUTE, "test chunk")
+        {
+            records[2] = test_chunk(2, records[1], use_batch ? &divisors : NULL, &local_primes);
+        }
+        records[3] = 0;
+        rec_count = 1;
+        busy = MPI_Wtime() - start;
+    }
+    else if (rank == 0)
+    {
+        MPI_TRACE_SCOPE(MPI_TRACE_COMM, "serve chunk requests")
+        {
+            handed_out = dynamic_master(n, workers);
+        }
+    }
+    else
+    {
+        int chunk[2];
+        for (int i = 0; i < DYNAMIC_PREFETCH; i++)
+            MPI_Send(NULL, 0, MPI_INT, 0, TAG_REQUEST, MPI_COMM_WORLD);
+
+        // Replies come back in request order, and once the range is exhausted every
+        // reply is an empty chunk, so exactly DYNAMIC_PREFETCH of them end the loop
+        for (int stops = 0; stops < DYNAMIC_PREFETCH;)
+        {
+            double t0 = mpi_trace_begin();
+            MPI_Recv(chunk, 2, MPI_INT, 0, TAG_CHUNK, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            mpi_trace_end(MPI_TRACE_COMM, "wait for chunk", t0);
+            wait += MPI_Wtime() - t0;
+            if (chunk[0] >= chunk[1])
+            {
+                stops++;
+                continue;
+            }
+
+            // Ask for the next chunk before working on this one
+            MPI_Send(NULL, 0, MPI_INT, 0, TAG_REQUEST, MPI_COMM_WORLD);
+
+            t0 = mpi_trace_begin();
+            if (rec_count == rec_capacity)
+            {
+                rec_capacity *= 2;
+                records = realloc(records, rec_capacity * 4 * sizeof(int));
+            }
+            int *r = records + 4 * rec_count++;
+            r[0] = chunk[0];
+            r[1] = chunk[1];
+            r[3] = (int)local_primes.count;
+            r[2] = test_chunk(chunk[0], chunk[1], use_batch ? &divisors : NULL, &local_primes);
+            mpi_trace_end(MPI_TRACE_COMPUTE, "test chunk", t0);
+            busy += MPI_Wtime() - t0;
+        }
+    }
+    double finish = MPI_Wtime() - start;
+    int local_count = (int)local_primes.count;
+
+    // --- Per-rank load report ---
+    double stats[4] = {busy, wait, finish, (double)rec_count};
+    double *all_stats = NULL;
+    int *all_counts = NULL;
+    if (rank == 0)
+    {
+        all_stats = malloc(4 * no_of_processes * sizeof(double));
+        all_counts = malloc(no_of_processes * sizeof(int));
+    }
+    MPI_TRACE_SCOPE(MPI_TRACE_COMM, "gather load stats")
+    {
+        MPI_Gather(stats, 4, MPI_DOUBLE, all_stats, 4, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        MPI_Gather(&local_count, 1, MPI_INT, all_counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    }
+
+    if (rank == 0)
+    {
+        double max_busy = 0, sum_busy = 0;
+        int first = workers == 0 ? 0 : 1;
+        fprintf(stderr, "Rank   Chunks   Busy(s)   Wait(s)   Done(s)   Primes\n");
+        for (int i = 0; i < no_of_processes; i++)
+        {
+            double *st = all_stats + 4 * i;
+            if (i == 0 && workers > 0)
+            {
+                fprintf(stderr, "%4d   master, %d chunks handed out\n", i, handed_out);
+                continue;
+            }
+            fprintf(stderr, "%4d   %6d   %7.4f   %7.4f   %7.4f   %6d\n", i, (int)st[3], st[0], st[1], st[2],
+                    all_counts[i]);
+            sum_busy += st[0];
+            if (st[0] > max_busy)
+                max_busy = st[0];
+        }
+        double mean_busy = sum_busy / (no_of_processes - first);
+        fprintf(stderr, "Load imbalance (max/mean busy): %.3f\n", mean_busy > 0 ? max_busy / mean_busy : 1.0);
+        free(all_stats);
+    }
+
+    // --- Gather chunk records and primes, then lay the chunks out by lo ---
+    int *rec_counts = NULL, *rec_displs = NULL, *prime_displs = NULL;
+    int total_records = 0, total_primes = 0;
+    int my_rec_ints = 4 * rec_count;
+    if (rank == 0)
+    {
+        rec_counts = malloc(no_of_processes * sizeof(int));
+        rec_displs = malloc(no_of_processes * sizeof(int));
+        prime_displs = malloc(no_of_processes * sizeof(int));
+    }
+    double trace_start = mpi_trace_begin();
+    MPI_Gather(&my_rec_ints, 1, MPI_INT, rec_counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    int *all_records = NULL, *gathered = NULL;
+    if (rank == 0)
+    {
+        for (int i = 0; i < no_of_processes; i++)
+        {
+            rec_displs[i] = total_records;
+            prime_displs[i] = total_primes;
+            total_records += rec_counts[i];
+            total_primes += all_counts[i];
+        }
+        all_records = malloc((total_records + 1) * sizeof(int));
+        gathered = malloc((total_primes + 1) * sizeof(int));
+    }
+    MPI_Gatherv(records, my_rec_ints, MPI_INT, all_records, rec_counts, rec_displs, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Datatype arena_type = prime_arena_mpi_type(&local_primes);
+    MPI_Gatherv(MPI_BOTTOM, 1, arena_type, gathered, all_counts, prime_displs, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Type_free(&arena_type);
+    mpi_trace_end(MPI_TRACE_COMM, "gather chunks", trace_start);
+
+    if (rank == 0)
+    {
+        // Make every record's offset global, then order the chunks by their lo
+        for (int i = 0; i < no_of_processes; i++)
+        {
+            for (int j = rec_displs[i]; j < rec_displs[i] + rec_counts[i]; j += 4)
+                all_records[j + 3] += prime_displs[i];
+        }
+        qsort(all_records, total_records / 4, 4 * sizeof(int), compare_ints); // compares lo
+
+        MPI_TRACE_SCOPE(MPI_TRACE_IO, "print primes")
+        {
+            printf("Primes less than %d:\n", n);
+            for (int c = 0; c < total_records / 4; c++)
+            {
+                int *r = all_records + 4 * c;
+                for (int j = r[3]; j < r[3] + r[2]; j++)
+                    printf("%d ", gathered[j]);
+            }
+            printf("\n");
+            fflush(stdout);
+        }
+
+        free(all_records);
+        free(gathered);
+        free(rec_counts);
+        free(rec_displs);
+        free(prime_displs);
+        free(all_counts);
+    }
+
+    report_rss(rank, prime_arena_bytes(&local_primes));
+    if (use_batch)
+        prime_divisors_free(&divisors);
+    prime_arena_free(&local_primes);
+    free(records);
+    return 0;
+}
+
+// Answer chunk requests until every worker has been sent DYNAMIC_PREFETCH empty chunks;
+// returns how many non-empty chunks were handed out
+int dynamic_master(int n, int workers)
+{
+    int next = 2, stops = 0, handed_out = 0;
+    int chunk[2];
+    MPI_Status status;
+
+    while (stops < workers * DYNAMIC_PREFETCH)
+    {
+        MPI_Recv(NULL, 0, MPI_INT, MPI_ANY_SOURCE, TAG_REQUEST, MPI_COMM_WORLD, &status);
+
+        // Guided: a share of what is left, never below DYNAMIC_MIN_CHUNK
+        int remaining = n - next;
+        int size = remaining / (2 * workers);
+        if (size < DYNAMIC_MIN_CHUNK)
+            size = DYNAMIC_MIN_CHUNK;
+        if (size > remaining)
+            size = remaining > 0 ? remaining : 0;
+
+        chunk[0] = next;
+        chunk[1] = next + size;
+        next += size;
+        if (size == 0)
+            stops++;
+        else
+            handed_out++;
+        MPI_Send(chunk, 2, MPI_INT, status.MPI_SOURCE, TAG_CHUNK, MPI_COMM_WORLD);
+    }
+    return handed_out;
+}
+
+// Append the primes in [lo, hi) to the arena; returns how many were added
+int test_chunk(int lo, int hi, const PrimeDivisors *divisors, PrimeArena *primes)
+{
+    long long before = primes->count;
+    if (divisors != NULL)
+    {
+        // The kernel writes a run of primes at once: reserve one sub-range's worth at a time
+        for (int sub = lo; sub < hi; sub += RESERVE_SPAN)
+        {
+            int sub_hi = hi - sub > RESERVE_SPAN ? sub + RESERVE_SPAN : hi;
+            int *out = prime_arena_reserve(primes, sub_hi - sub);
+            prime_arena_commit(primes, prime_batch_range(divisors, sub, sub_hi, out));
+        }
+    }
+    else
+    {
+        for (int k = lo; k < hi; k++)
+        {
+            if (prime_test_u32(k))
+                prime_arena_push(primes, k);
+        }
+    }
+    return (int)(primes->count - before);
+}
+
+// Peak RSS over the ranks next to the arena bytes, on stderr. Collective.
+void report_rss(int rank, long long arena_bytes)
+{
+    long long local[2] = {prime_peak_rss_kb(), arena_bytes};
+    long long max[2], sum[2];
+    MPI_Reduce(local, max, 2, MPI_LONG_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(local, sum, 2, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (rank == 0)
+    {
+        fprintf(stderr, "Peak RSS: %.1f MiB max per rank, %.1f MiB total (result arenas: %.1f MiB max, %.1f MiB total)\n",
+                max[0] / 1024.0, sum[0] / 1024.0, max[1] / 1048576.0, sum[1] / 1048576.0);
+    }
+}